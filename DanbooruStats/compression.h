@@ -0,0 +1,60 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <magic_enum_containers.hpp>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/* Content codings we can send, most preferred first. Brotli needs DANBOORUSTATS_BROTLI */
+enum class content_encoding {
+    br,
+    gzip,
+};
+
+/* Smaller bodies aren't worth compressing, they fit in a packet or two anyway */
+inline constexpr size_t min_compressed_size = 1024;
+
+/* A body in a content coding, with the ETag of that representation */
+struct encoded_body {
+    content_encoding encoding;
+    std::string body;
+    std::string etag;
+};
+
+/* Whether encoding is compiled in */
+[[nodiscard]] bool encoding_supported(content_encoding encoding);
+
+/* Compressed body, or nullopt if it isn't supported or doesn't get any smaller */
+[[nodiscard]] std::optional<std::string> compress(content_encoding encoding, std::string_view body);
+
+/* Whether an Accept-Encoding header value allows encoding, q=0 refuses it */
+[[nodiscard]] bool accepts_encoding(std::string_view accept_encoding, content_encoding encoding);
+
+/* Text types, which compress well, others are usually compressed already */
+[[nodiscard]] bool compressible_type(std::string_view content_type);
+
+/* The compressed representations of a body. Filled in once by a background thread while the
+ * identity body is served, so readers see either nothing or a complete body per encoding.
+ */
+class encoded_bodies {
+    magic_enum::containers::array<content_encoding, std::atomic<std::shared_ptr<const encoded_body>>> _bodies;
+    std::atomic<bool> _queued { false };
+
+    public:
+    /* True the first time only, so a body is compressed once */
+    [[nodiscard]] bool try_queue();
+
+    /* Compress body with every supported encoding, etag is the ETag of the identity body */
+    void encode(std::string_view body, std::string_view etag);
+
+    /* The most preferred body the client accepts, nullptr if there's none (yet) */
+    [[nodiscard]] std::shared_ptr<const encoded_body> select(std::string_view accept_encoding) const;
+
+    [[nodiscard]] size_t memory_usage() const;
+};
+
+#endif /* COMPRESSION_H */
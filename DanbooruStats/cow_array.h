@@ -0,0 +1,58 @@
+#ifndef COW_ARRAY_H
+#define COW_ARRAY_H
+
+#include "memory_footprint.h"
+
+#include <span>
+#include <vector>
+
+/* Copy-on-write array. Either owns it's elements, or refers to read-only memory owned
+ * by someone else (e.g. a mapped snapshot), which is copied the first time it's modified.
+ */
+template <typename T>
+class cow_array {
+    std::vector<T> _owned;
+    std::span<const T> _external;
+    bool _is_external = false;
+
+    public:
+    cow_array() = default;
+    cow_array(std::vector<T> owned) : _owned { std::move(owned) } { }
+    explicit cow_array(std::span<const T> external) : _external { external }, _is_external { true } { }
+
+    [[nodiscard]] std::span<const T> span() const {
+        return _is_external ? _external : std::span<const T> { _owned };
+    }
+
+    operator std::span<const T>() const {
+        return span();
+    }
+
+    [[nodiscard]] const T& operator[](size_t i) const { return span()[i]; }
+    [[nodiscard]] size_t size() const { return span().size(); }
+    [[nodiscard]] bool empty() const { return span().empty(); }
+    [[nodiscard]] auto begin() const { return span().begin(); }
+    [[nodiscard]] auto end() const { return span().end(); }
+
+    [[nodiscard]] bool is_external() const { return _is_external; }
+
+    /* Heap memory owned by this array, external memory is not counted */
+    [[nodiscard]] size_t owned_bytes() const { return _owned.capacity() * sizeof(T); }
+
+    [[nodiscard]] memory_footprint footprint() const {
+        return { owned_bytes(), _is_external ? _external.size_bytes() : 0 };
+    }
+
+    /* Access for modification, copying external memory first if needed */
+    [[nodiscard]] std::vector<T>& mutate() {
+        if (_is_external) {
+            _owned.assign(_external.begin(), _external.end());
+            _external = {};
+            _is_external = false;
+        }
+
+        return _owned;
+    }
+};
+
+#endif /* COW_ARRAY_H */
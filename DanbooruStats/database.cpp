@@ -1,228 +1,914 @@
 #include "database.h"
 
+#include "post_loader.h"
+#include "snapshot.h"
 #include "util.h"
 
-#include <SQLiteCpp/SQLiteCpp.h>
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <optional>
 #include <ranges>
 #include <stdexcept>
 
 using std::chrono::steady_clock;
 
-user_stats::user_stats(database& db, int32_t id, std::vector<post*> posts)
-    : _db { db }, _id { id }, _posts { std::move(posts) } {
+static void count_tags(const tag_column& column, std::span<const post_row> rows, tag_count_map& counts) {
+    for (post_row row : rows) {
+        for (tag_id tag : column[row]) {
+            auto it = counts.find(tag);
+            if (it == counts.end()) {
+                counts.emplace(tag, 1);
+            } else {
+                it->second += 1;
+            }
+        }
+    }
+}
+
+/* Adjust a single count in an array sorted by tag, returns the new count */
+static int32_t apply_count(std::vector<tag_count>& counts, tag_id tag, int32_t delta) {
+    auto it = std::ranges::lower_bound(counts, tag, {}, &tag_count::tag);
+    if (it == counts.end() || it->tag != tag) {
+        if (delta <= 0) {
+            return 0;
+        }
+
+        counts.insert(it, { tag, delta });
+        return delta;
+    }
+
+    it->count += delta;
+
+    int32_t res = it->count;
+    if (res <= 0) {
+        counts.erase(it);
+        return 0;
+    }
+
+    return res;
+}
+
+[[nodiscard]] static std::vector<tag_count> sorted_counts(const tag_count_map& counts) {
+    std::vector<tag_count> res;
+    res.reserve(counts.size());
+
+    for (const auto& [tag, count] : counts) {
+        res.push_back({ tag, count });
+    }
+
+    std::ranges::sort(res, {}, &tag_count::tag);
+
+    return res;
+}
+
+/* Up to limit counts by count descending */
+[[nodiscard]] static std::vector<tag_count> top_counts(std::span<const tag_count> counts, size_t limit) {
+    std::vector<tag_count> res { counts.begin(), counts.end() };
+
+    auto by_count = [](const tag_count& l, const tag_count& r) {
+        return (l.count != r.count) ? (l.count > r.count) : (l.tag < r.tag);
+    };
+
+    limit = std::min(limit, res.size());
+    std::ranges::partial_sort(res, res.begin() + limit, by_count);
+    res.resize(limit);
+    res.shrink_to_fit();
+
+    return res;
+}
+
+/* Merge all maps into the first one pairwise, every round halves the number of maps left */
+static void tree_reduce(thread_pool& pool, std::span<tag_count_map> maps) {
+    for (size_t step = 1; step < maps.size(); step *= 2) {
+        size_t pairs = (maps.size() + (2 * step) - 1) / (2 * step);
+
+        pool.parallel_for(pairs, [maps, step](size_t i) {
+            size_t dst = i * 2 * step;
+            size_t src = dst + step;
+            if (src >= maps.size()) {
+                return;
+            }
+
+            /* Insert the smaller map into the larger one */
+            if (maps[src].size() > maps[dst].size()) {
+                std::swap(maps[src], maps[dst]);
+            }
+
+            for (const auto& [tag, count] : maps[src]) {
+                auto it = maps[dst].find(tag);
+                if (it == maps[dst].end()) {
+                    maps[dst].emplace(tag, count);
+                } else {
+                    it->second += count;
+                }
+            }
+
+            maps[src] = {};
+        });
+    }
+}
+
+user_stats::user_stats(database& db, int32_t id, std::span<const post_row> posts)
+    : _db { db }, _id { id }, _posts { posts } {
     _populate();
 }
 
-void user_stats::add_post(post& post) {
-    _posts.push_back(&post);
+user_stats::user_stats(database& db, int32_t id, std::span<const post_row> posts, const tag_type_array<std::span<const ::tag_count>>& counts)
+    : _db { db }, _id { id }, _posts { posts } {
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tag_counts[type] = cow_array { counts[type] };
+    }
+}
+
+void user_stats::add_post(post_row row) {
+    _posts.mutate().push_back(row);
 }
 
-std::span<post*> user_stats::posts() {
+std::span<const post_row> user_stats::posts() const {
     return _posts;
 }
 
-const tag_count_map& user_stats::tag_count(tag_type type) {
+std::span<const tag_count> user_stats::tag_count(tag_type type) const {
     return _tag_counts.at(type);
 }
 
+std::span<const tag_count> user_stats::top_tags(tag_type type) const {
+    std::scoped_lock lock { _top_lock };
+
+    auto& top = _top_tags[type];
+    if (!top) {
+        top = top_counts(_tag_counts[type], top_size);
+    }
+
+    return *top;
+}
+
+size_t user_stats::memory_usage() const {
+    size_t res = sizeof(*this) + _posts.owned_bytes();
+    for (const auto& counts : _tag_counts) {
+        res += counts.owned_bytes();
+    }
+
+    std::scoped_lock lock { _top_lock };
+    for (const auto& top : _top_tags) {
+        res += top ? (top->capacity() * sizeof(::tag_count)) : 0;
+    }
+
+    return res;
+}
+
+void user_stats::apply(tag_type type, tag_id tag, int32_t delta) {
+    apply_count(_tag_counts[type].mutate(), tag, delta);
+
+    /* Only called while nobody is reading */
+    _top_tags[type].reset();
+}
+
 void user_stats::_populate() {
-    auto old_level = spdlog::get_level();
-    spdlog::info("Populating user #{}", _id);
-    spdlog::set_level(spdlog::level::warn);
+    spdlog::debug("Populating user #{}", _id);
 
     auto begin = steady_clock::now();
 
-    for (tag_type type : magic_enum::enum_values<tag_type>()) {
-        tag_count_map counts;
-        for (const post* post_p : _posts) {
-            const post& post = *post_p;
+    /* Large uploaders are split into chunks which are counted in parallel */
+    static constexpr size_t chunk_size = 16384;
+    size_t chunks = (_posts.size() + chunk_size - 1) / chunk_size;
 
-            for (const auto& tag : post.tags[type] | std::views::split(' ')) {
-                std::string_view sv { tag.begin(), tag.end() };
+    tag_type_array<std::vector<tag_count_map>> partial;
+    for (auto& maps : partial) {
+        maps.resize(chunks);
+    }
 
-                auto it = counts.find(sv);
-                if (it == counts.end()) {
-                    counts[sv] = 1;
-                } else {
-                    it->second += 1;
-                }
-            }
+    thread_pool& pool = _db.pool();
+    pool.parallel_for(chunks, [&](size_t i) {
+        auto rows = _posts.span().subspan(i * chunk_size, std::min(chunk_size, _posts.size() - (i * chunk_size)));
+
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            /* Only touch the tag column we're counting */
+            count_tags(_db.posts().tags(type), rows, partial[type][i]);
         }
+    });
 
-        _tag_counts[type] = std::move(counts);
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        if (chunks > 0) {
+            tree_reduce(pool, partial[type]);
+            _tag_counts[type] = sorted_counts(partial[type].front());
+        }
     }
 
     auto end = steady_clock::now();
 
-    spdlog::set_level(old_level);
-    spdlog::info("  Done ({})", end - begin);
+    spdlog::debug("  Done ({})", end - begin);
 }
 
 
-database::database(const std::string& path) {
-    /* Load entire database into a :memory: database before accessing */
-#define USE_MEMORY_BACKUP_DATABASE 0
-#if USE_MEMORY_BACKUP_DATABASE
-    SQLite::Database db { ":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE };
+static void check_stop(const database_options& options) {
+    if (options.stop.stop_requested()) {
+        throw load_stopped { "Loading was stopped" };
+    }
+}
+
+database::database(const std::string& path, const database_options& options, std::shared_ptr<database_context> context)
+    : _context { context ? std::move(context) : std::make_shared<database_context>(options.worker_threads, options.tag_catalog) }
+    , _pool { _context->pool }, _tags { _context->tags }, _cache { options.cache_budget } {
+    if (snapshot_reader::is_snapshot(path)) {
+        _read_snapshot(path);
+    } else {
+        _load(path, options);
+    }
+
+    check_stop(options);
+
+    if (options.prepopulate_cache) {
+        _prepopulate();
+    }
 
-    {
-        auto begin = std::chrono::steady_clock::now();
-        db.backup(path.c_str(), SQLite::Database::Load);
-        auto end = std::chrono::steady_clock::now();
+    _index.build(_posts, _tags.size(), _pool);
+    check_stop(options);
 
-        spdlog::info("Loaded database into memory in {}", end - begin);
+    if (options.cooccurrence_budget > 0) {
+        _cooccurrence.build(_posts, _index, options.cooccurrence_budget, _pool);
     }
-#else
-    SQLite::Database db { path, SQLite::OPEN_READONLY };
-#endif
+
+    if (options.user_percentiles) {
+        _percentiles.build({ { &_posts, &_index } }, _tags.size(), _pool);
+    }
+
+    _build_leaderboards();
+    _build_sketches();
+
+    _log_memory();
+}
+
+void database::_load(const std::string& path, const database_options& options) {
     auto begin = steady_clock::now();
 
-    SQLite::Statement post_count { db, "select count(*) from posts" };
-    post_count.executeStep();
+    /* Snapshots bring their own tags, so only the first database loaded from SQLite attaches it */
+    if (_context->catalog && _tags.size() == 0) {
+        _tags.attach(*_context->catalog);
+        spdlog::info("Using a catalog of {} tags", _context->catalog->size());
+    }
 
-    _posts.resize(post_count.getColumn(0).getInt());
+    user_post_map user_posts;
+    post_loader { path, options.loader_threads, options.stop }.load(_tags, _posts, user_posts);
 
     auto end = steady_clock::now();
-    spdlog::info("Allocated {} posts in {}", _posts.size(), end - begin);
+
+    spdlog::info("Loaded {} posts with {} unique tags in {}", _posts.size(), _tags.size(), end - begin);
+
+    for (auto& [uploader_id, posts] : user_posts) {
+        _user_posts.emplace(uploader_id, std::move(posts));
+    }
+
+    user_posts.clear();
 
     begin = steady_clock::now();
 
-    SQLite::Statement posts { db, "select * from posts" };
+    /* Global counts only need the tag columns, count slices of them into partial maps and reduce those */
+    static constexpr size_t slice_size = size_t { 1 } << 20;
 
-    db_map_type<int32_t, std::vector<post*>> user_posts;
+    tag_type_array<std::vector<tag_count_map>> partial;
+    std::vector<std::pair<tag_type, size_t>> slices;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        size_t count = (_posts.tags(type).values().size() + slice_size - 1) / slice_size;
+        partial[type].resize(count);
 
-    for (size_t i = 0; posts.executeStep(); ++i) {
-        post& post = _posts[i];
-        post.id = posts.getColumn(0).getInt();
-        post.uploader_id = posts.getColumn(1).getInt();
+        for (size_t i = 0; i < count; ++i) {
+            slices.emplace_back(type, i);
+        }
+    }
 
-        for (tag_type type : magic_enum::enum_values<tag_type>()) {
-            post.tags[type] = posts.getColumn(tag_column_index[type]).getString();
+    _pool.parallel_for(slices.size(), [&](size_t i) {
+        auto [type, slice] = slices[i];
+        auto values = _posts.tags(type).values();
+
+        tag_count_map& counts = partial[type][slice];
+        for (tag_id tag : values.subspan(slice * slice_size, std::min(slice_size, values.size() - (slice * slice_size)))) {
+            auto it = counts.find(tag);
+            if (it == counts.end()) {
+                counts.emplace(tag, 1);
+            } else {
+                it->second += 1;
+            }
         }
+    });
 
-        auto it = user_posts.find(post.uploader_id);
-        if (it == user_posts.end()) {
-            user_posts.emplace(post.uploader_id, std::vector{ &post });
-        } else {
-            it->second.push_back(&post);
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        if (!partial[type].empty()) {
+            tree_reduce(_pool, partial[type]);
+            _tag_counts[type] = sorted_counts(partial[type].front());
         }
     }
 
     end = steady_clock::now();
 
-    spdlog::info("Loaded {} posts in {}", _posts.size(), end - begin);
-
-    auto old_level = spdlog::get_level();
-    spdlog::set_level(spdlog::level::warn);
+    spdlog::info("Calculated tag counts in {}", end - begin);
 
     begin = steady_clock::now();
 
-    for (auto& [uploader_id, posts] : user_posts) {
-        /* Count stats for this user */
-        user_stats& stats =
-            _stats.emplace(uploader_id, user_stats { *this, uploader_id, std::move(user_posts.at(uploader_id)) }).first->second;
+    /* Only the top is ranked here, the rest is finished in the background */
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tag_rankings[type].build(_tag_counts[type], _tags.size(), _pool);
+    }
+
+    end = steady_clock::now();
+
+    spdlog::info("Ranked top {} tags in {}", tag_ranking::top_size, end - begin);
+}
+
+void database::_log_memory() const {
+    memory_footprint total;
+    for (const auto& [name, footprint] : memory_report()) {
+        spdlog::info("  {}: {} owned, {} mapped", name, format_bytes { footprint.owned }, format_bytes { footprint.mapped });
+        total += footprint;
+    }
+
+    spdlog::info("Using {} owned and {} mapped ({} resident)", format_bytes { total.owned }, format_bytes { total.mapped }, format_bytes { resident_memory() });
+}
 
-        /* Collect stat counts */
+/* Whether offsets split values [0, size) into consecutive ranges, which are then taken unchecked */
+static bool valid_offsets(std::span<const uint32_t> offsets, size_t size) {
+    return !offsets.empty() && offsets.front() == 0 && offsets.back() <= size && std::ranges::is_sorted(offsets);
+}
+
+void database::_read_snapshot(const std::string& path) {
+    auto begin = steady_clock::now();
+
+    _snapshot = std::make_unique<mapped_file>(path);
+    snapshot_reader reader { _snapshot->data() };
+
+    _tags.read(reader);
+    _posts.read(reader, _tags.size());
+
+    auto user_ids = reader.read<int32_t>();
+    auto post_offsets = reader.read<uint32_t>();
+    auto user_posts = reader.read<post_row>();
+
+    tag_type_array<std::span<const uint32_t>> count_offsets;
+    tag_type_array<std::span<const tag_count>> counts;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        count_offsets[type] = reader.read<uint32_t>();
+        counts[type] = reader.read<tag_count>();
+
+        if (count_offsets[type].size() != user_ids.size() + 1 || !valid_offsets(count_offsets[type], counts[type].size())) {
+            throw std::runtime_error { "Corrupt user stats in snapshot" };
+        }
+    }
+
+    if (post_offsets.size() != user_ids.size() + 1 || !valid_offsets(post_offsets, user_posts.size())) {
+        throw std::runtime_error { "Corrupt user stats in snapshot" };
+    }
+
+    if (std::ranges::any_of(user_posts, [this](post_row row) { return row >= _posts.size(); })) {
+        throw std::runtime_error { "Corrupt user stats in snapshot" };
+    }
+
+    for (size_t i = 0; i < user_ids.size(); ++i) {
+        tag_type_array<std::span<const tag_count>> user_counts;
         for (tag_type type : magic_enum::enum_values<tag_type>()) {
-            const tag_count_map& counts = stats.tag_count(type);
+            user_counts[type] = counts[type].subspan(count_offsets[type][i], count_offsets[type][i + 1] - count_offsets[type][i]);
+        }
 
-            for (const auto& [tag, count] : counts) {
-                tag_count_map& this_counts = _tag_counts[type];
-                auto it = this_counts.find(tag);
+        _user_posts.emplace(user_ids[i], cow_array { user_posts.subspan(post_offsets[i], post_offsets[i + 1] - post_offsets[i]) });
+        _snapshot_counts.emplace(user_ids[i], user_counts);
+    }
 
-                if (it == this_counts.end()) {
-                    this_counts.emplace(tag, count);
-                } else {
-                    it->second += count;
-                }
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tag_counts[type] = cow_array { reader.read<tag_count>() };
+        _tag_rankings[type].read(reader, _tags.size(), _pool);
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Opened snapshot with {} posts, {} unique tags and {} users in {}", _posts.size(), _tags.size(), _user_posts.size(), end - begin);
+}
+
+void database::write_snapshot(const std::string& path) {
+    auto begin = steady_clock::now();
+
+    auto lock = read_lock();
+
+    snapshot_writer writer { path };
+
+    _tags.write(writer);
+    _posts.write(writer);
+
+    /* Flatten all users into arrays sorted by user ID */
+    std::vector<int32_t> user_ids;
+    user_ids.reserve(_user_posts.size());
+    for (const auto& [id, posts] : _user_posts) {
+        user_ids.push_back(id);
+    }
+
+    std::ranges::sort(user_ids);
+
+    std::vector<uint32_t> post_offsets { 0 };
+    std::vector<post_row> user_posts;
+
+    tag_type_array<std::vector<uint32_t>> count_offsets;
+    tag_type_array<std::vector<tag_count>> counts;
+    for (auto& offsets : count_offsets) {
+        offsets.push_back(0);
+    }
+
+    /* Calculate users in batches without caching them, so we never hold all of them at once */
+    static constexpr size_t batch_size = 4096;
+
+    std::vector<std::shared_ptr<const user_stats>> batch;
+    for (size_t first = 0; first < user_ids.size(); first += batch_size) {
+        batch.resize(std::min(batch_size, user_ids.size() - first));
+
+        _pool.parallel_for(batch.size(), [&](size_t i) {
+            batch[i] = _compute_stats(user_ids[first + i]);
+        });
+
+        for (const auto& stats : batch) {
+            auto posts = stats->posts();
+            user_posts.insert(user_posts.end(), posts.begin(), posts.end());
+            post_offsets.push_back(static_cast<uint32_t>(user_posts.size()));
+
+            for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                auto user_counts = stats->tag_count(type);
+                counts[type].insert(counts[type].end(), user_counts.begin(), user_counts.end());
+                count_offsets[type].push_back(static_cast<uint32_t>(counts[type].size()));
             }
         }
     }
 
-    end = steady_clock::now();
+    writer.write<int32_t>(user_ids);
+    writer.write<uint32_t>(post_offsets);
+    writer.write<post_row>(user_posts);
 
-    spdlog::set_level(old_level);
-    spdlog::info("Calculated tag counts in {}", end - begin);
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        writer.write<uint32_t>(count_offsets[type]);
+        writer.write<tag_count>(counts[type]);
+    }
 
-    begin = steady_clock::now();
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        writer.write<tag_count>(_tag_counts[type]);
+        _tag_rankings[type].write(writer);
+    }
 
-    /* Calculate rankings using a maxheap */
-    constexpr auto compare_tag_count = [](const tag_count_map::value_type& l, const tag_count_map::value_type& r) -> bool {
-        return l.second > r.second;
-    };
+    auto end = steady_clock::now();
+
+    spdlog::info("Wrote snapshot to {} in {}", path, end - begin);
+}
+
+std::shared_ptr<const user_stats> database::stats_for(int32_t id) {
+    if (!_user_posts.contains(id)) {
+        throw std::out_of_range(std::format("user #{} not found", id));
+    }
+
+    spdlog::info("Fetching data for user #{}", id);
+
+    return _cache.get(id, [this, id] { return _compute_stats(id); });
+}
+
+user_cache::counters database::cache_stats() const {
+    return _cache.stats();
+}
+
+std::vector<memory_entry> database::memory_report(bool include_context) const {
+    std::vector<memory_entry> res;
+
+    if (include_context) {
+        res.push_back({ "tag_dictionary", _tags.footprint() });
+    }
+    res.push_back({ "posts", _posts.footprint() });
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        res.push_back({ std::format("posts.tags.{}", magic_enum::enum_name(type)), _posts.tags(type).footprint() });
+    }
+
+    memory_footprint user_posts { .owned = map_bytes(_user_posts) };
+    for (const auto& [id, posts] : _user_posts) {
+        user_posts += posts.footprint();
+    }
+
+    res.push_back({ "user_posts", user_posts });
+    res.push_back({ "snapshot_counts", { .owned = map_bytes(_snapshot_counts) } });
+    res.push_back({ "user_cache", _cache.footprint() });
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        res.push_back({ std::format("tag_counts.{}", magic_enum::enum_name(type)), _tag_counts[type].footprint() });
+    }
 
     for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        res.push_back({ std::format("tag_rankings.{}", magic_enum::enum_name(type)), _tag_rankings[type].footprint() });
+    }
+
+    res.push_back({ "posting_index", _index.footprint() });
+    res.push_back({ "cooccurrence", _cooccurrence.footprint() });
+    res.push_back({ "user_percentiles", _percentiles.footprint() });
+    res.push_back({ "user_leaderboards", _leaderboards.footprint() });
+    res.push_back({ "distinct_sketches", _sketches.footprint() });
+
+    res.push_back({ "post_rows", { .owned = map_bytes(_post_rows) } });
 
-        const tag_count_map& counts = _tag_counts[type];
+    return res;
+}
+
+std::vector<int32_t> database::users() const {
+    std::vector<int32_t> res;
+    res.reserve(_user_posts.size());
 
-        std::vector<tag_count> heap;
-        heap.reserve(counts.size());
+    for (const auto& [id, posts] : _user_posts) {
+        res.push_back(id);
+    }
 
-        /* Sort as maxheap */
-        for (const auto& tag : counts) {
-            heap.emplace_back(tag.first, tag.second);
-            std::push_heap(heap.begin(), heap.end(), compare_tag_count);
+    return res;
+}
+
+bool database::has_user(int32_t id) const {
+    return _user_posts.contains(id);
+}
+
+std::shared_lock<std::shared_mutex> database::read_lock() const {
+    return std::shared_lock { _context->lock };
+}
+
+void database::apply(std::span<const post_version> versions) {
+    std::unique_lock lock { _context->lock };
+
+    _apply(versions);
+}
+
+void database::_apply(std::span<const post_version> versions) {
+    auto begin = steady_clock::now();
+
+    /* These read the tags we're about to change */
+    _cooccurrence.wait();
+    _percentiles.wait();
+    _leaderboards.wait();
+    _sketches.wait();
+
+    if (_post_rows.empty()) {
+        _build_update_index();
+    }
+
+    /* Net changes of this batch, so every count is only touched once */
+    tag_type_array<tag_count_map> global_deltas;
+    db_map_type<int32_t, tag_type_array<tag_count_map>> user_deltas;
+
+    size_t applied = 0;
+    for (const post_version& version : versions) {
+        auto row_it = _post_rows.find(version.post_id);
+        if (row_it == _post_rows.end()) {
+            continue;
         }
 
-        /* Convert to ascending order and store */
-        std::sort_heap(heap.begin(), heap.end(), compare_tag_count);
+        post_row row = row_it->second;
+        int32_t uploader_id = _posts.uploader_ids()[row];
+
+        auto adjust = [&](tag_type type, tag_id tag, int32_t delta) {
+            global_deltas[type][tag] += delta;
+            user_deltas[uploader_id][type][tag] += delta;
+        };
+
+        /* Changes that are already reflected in the post don't count twice */
+        for (const std::string& name : version.removed_tags) {
+            auto tag = _tags.find(name);
+            if (!tag) {
+                continue;
+            }
+
+            for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                auto tags = _posts.tags(type)[row];
+                auto it = std::ranges::lower_bound(tags, *tag);
+                if (it != tags.end() && *it == *tag) {
+                    std::vector<tag_id> updated { tags.begin(), it };
+                    updated.insert(updated.end(), it + 1, tags.end());
+
+                    _posts.set_tags(row, type, std::move(updated));
+                    _index.remove(*tag, row);
+                    adjust(type, *tag, -1);
+                    break;
+                }
+            }
+        }
+
+        for (const std::string& name : version.added_tags) {
+            tag_id tag = _tags.intern(name);
+
+            bool present = std::ranges::any_of(magic_enum::enum_values<tag_type>(), [&](tag_type type) {
+                return std::ranges::binary_search(_posts.tags(type)[row], tag);
+            });
+
+            if (present) {
+                continue;
+            }
 
-        _tag_rankings[type] = std::move(heap);
+            tag_type type = _type_of(tag);
+
+            auto tags = _posts.tags(type)[row];
+            std::vector<tag_id> updated { tags.begin(), tags.end() };
+            updated.insert(std::ranges::upper_bound(updated, tag), tag);
+
+            _posts.set_tags(row, type, std::move(updated));
+            _index.add(tag, row);
+            _sketches.add(uploader_id, type, tag);
+            adjust(type, tag, 1);
+        }
+
+        applied += 1;
     }
 
-    end = steady_clock::now();
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        for (const auto& [tag, delta] : global_deltas[type]) {
+            if (delta != 0) {
+                int32_t count = apply_count(_tag_counts[type].mutate(), tag, delta);
+                _tag_rankings[type].update(tag, count);
+            }
+        }
+    }
 
-    spdlog::info("Generates tag rankings in {}", end - begin);
+    for (const auto& [uploader_id, deltas] : user_deltas) {
+        /* Snapshot counts are outdated now, calculate from the updated posts next time */
+        _snapshot_counts.erase(uploader_id);
 
-    /* Forcibly populate all users */
-#define PREPOPULATE_CACHE 0
-#if PREPOPULATE_CACHE
-    begin = steady_clock::now();
+        _cache.update(uploader_id, [&deltas](user_stats& stats) {
+            for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                for (const auto& [tag, delta] : deltas[type]) {
+                    if (delta != 0) {
+                        stats.apply(type, tag, delta);
+                    }
+                }
+            }
+        });
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Applied {} of {} post versions affecting {} users in {}", applied, versions.size(), user_deltas.size(), end - begin);
+}
 
-    db_set_type<int32_t> distinct_uploaders;
-    for (const post& post : _posts) {
-        distinct_uploaders.insert(post.uploader_id);
+std::shared_ptr<user_stats> database::_compute_stats(int32_t id) {
+    if (auto it = _snapshot_counts.find(id); it != _snapshot_counts.end()) {
+        return std::make_shared<user_stats>(*this, id, _user_posts.at(id).span(), it->second);
     }
 
-    end = steady_clock::now();
+    return std::make_shared<user_stats>(*this, id, _user_posts.at(id).span());
+}
 
-    spdlog::info("Fetched {} users in {}", distinct_uploaders.size(), end - begin);
+void database::_build_leaderboards() {
+    user_leaderboards::source source { .posts = &_posts };
+    source.users.reserve(_user_posts.size());
+    for (const auto& [uploader_id, posts] : _user_posts) {
+        source.users.emplace_back(uploader_id, posts.span());
+    }
 
-    begin = steady_clock::now();
+    std::vector<user_leaderboards::source> sources;
+    sources.push_back(std::move(source));
 
-    int32_t i = 1;
-    for (int32_t uploader_id : distinct_uploaders) {
-        spdlog::info("{} / {} ({} elapsed)", i++, distinct_uploaders.size(), steady_clock::now() - end);
-        stats_for(uploader_id).populate();
+    _leaderboards.build(std::move(sources), _pool);
+}
+
+void database::_build_sketches() {
+    std::vector<std::pair<int32_t, std::span<const post_row>>> users;
+    users.reserve(_user_posts.size());
+    for (const auto& [uploader_id, posts] : _user_posts) {
+        users.emplace_back(uploader_id, posts.span());
     }
 
-    end = steady_clock::now();
+    _sketches.build(_posts, _index, std::move(users), _tags.size(), _pool);
+}
+
+void database::_build_update_index() {
+    auto begin = steady_clock::now();
 
-    spdlog::info("Populated all users in {}", end - begin);
-#endif
+    std::span<const int32_t> ids = _posts.ids();
+    _post_rows.reserve(ids.size());
+    for (post_row row = 0; row < ids.size(); ++row) {
+        _post_rows.emplace(ids[row], row);
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Indexed {} posts for updates in {}", _post_rows.size(), end - begin);
 }
 
-database::~database() {
-    
+posting_list database::_match(const tag_query& query) const {
+    /* Owned lists the views below may refer to */
+    std::vector<posting_list> users;
+    for (int32_t user_id : query.users) {
+        auto it = _user_posts.find(user_id);
+        if (it == _user_posts.end()) {
+            return {};
+        }
+
+        std::vector<post_row> rows { it->second.begin(), it->second.end() };
+        std::ranges::sort(rows);
+
+        users.push_back(posting_list::from_sorted(rows));
+    }
+
+    std::vector<posting_view> required { users.begin(), users.end() };
+    for (const std::string& name : query.required) {
+        auto tag = _tags.find(name);
+        if (!tag) {
+            return {};
+        }
+
+        required.push_back(_index[*tag]);
+    }
+
+    /* Smallest first, so every intersection is at most as large as that */
+    std::ranges::sort(required, {}, &posting_view::size);
+
+    if (required.empty() && query.any.empty()) {
+        throw std::invalid_argument { "Queries need at least one tag, ~tag or user" };
+    }
+
+    posting_list res;
+    if (!required.empty()) {
+        res = posting_list { required.front() };
+        for (size_t i = 1; i < required.size() && !res.empty(); ++i) {
+            res = intersect(res, required[i]);
+        }
+    }
+
+    if (!query.any.empty()) {
+        posting_list any;
+        for (const std::string& name : query.any) {
+            if (auto tag = _tags.find(name)) {
+                any = unite(any, _index[*tag]);
+            }
+        }
+
+        res = required.empty() ? std::move(any) : intersect(res, any);
+    }
+
+    for (const std::string& name : query.excluded) {
+        if (res.empty()) {
+            break;
+        }
+
+        if (auto tag = _tags.find(name)) {
+            res = subtract(res, _index[*tag]);
+        }
+    }
+
+    return res;
+}
+
+tag_type database::_type_of(tag_id tag) const {
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        if (_tag_rankings[type].rank(tag)) {
+            return type;
+        }
+    }
+
+    /* Tags nobody used yet */
+    if (const tag_catalog* catalog = _tags.catalog(); catalog && tag < catalog->size()) {
+        if (auto type = magic_enum::enum_cast<tag_type>(catalog->category(tag))) {
+            return *type;
+        }
+    }
+
+    /* Danbooru creates new tags as general tags */
+    return tag_type::general;
 }
 
-user_stats& database::stats_for(int32_t id) {
-    if (auto it = _stats.find(id); it != _stats.end()) {
-        spdlog::info("Fetching data for user #{} from cache", id);
+void database::_prepopulate() {
+    auto begin = steady_clock::now();
 
-        return it->second;
+    std::vector<std::pair<int32_t, size_t>> uploaders;
+    uploaders.reserve(_user_posts.size());
+    for (const auto& [uploader_id, posts] : _user_posts) {
+        uploaders.emplace_back(uploader_id, posts.size());
     }
-    
-    throw std::out_of_range(std::format("user #{} not found", id));
+
+    /* Start with the largest uploaders so the long tail fills in around them */
+    std::ranges::sort(uploaders, std::greater {}, &std::pair<int32_t, size_t>::second);
+
+    /* Don't log every single user */
+    auto old_level = spdlog::get_level();
+    spdlog::set_level(std::max(old_level, spdlog::level::warn));
+
+    _pool.parallel_for(uploaders.size(), [&](size_t i) {
+        int32_t id = uploaders[i].first;
+        (void) _cache.get(id, [this, id] { return _compute_stats(id); });
+    }, 8);
+
+    spdlog::set_level(old_level);
+
+    auto end = steady_clock::now();
+
+    auto cache = _cache.stats();
+    spdlog::info("Prepopulated {} of {} users ({} bytes) on {} threads in {}", cache.entries, uploaders.size(), cache.bytes, _pool.size(), end - begin);
+}
+
+const post_table& database::posts() const {
+    return _posts;
+}
+
+thread_pool& database::pool() {
+    return _pool;
 }
 
-const tag_count_map& database::tag_counts(tag_type type) const {
+std::span<const tag_count> database::tag_counts(tag_type type) const {
     return _tag_counts.at(type);
 }
 
-std::span<const tag_count> database::tag_rankings(tag_type type) const {
+const tag_ranking& database::tag_rankings(tag_type type) const {
     return _tag_rankings.at(type);
 }
+
+std::vector<tag_count> database::related_tags(tag_id tag, tag_type type) const {
+    if (!_cooccurrence.ready()) {
+        throw not_ready { "Related tags are still being counted" };
+    }
+
+    return _cooccurrence.related(tag, type);
+}
+
+bool database::related_tags_pruned(tag_id tag) const {
+    if (!_cooccurrence.ready()) {
+        throw not_ready { "Related tags are still being counted" };
+    }
+
+    return _cooccurrence.pruned(tag);
+}
+
+const user_percentiles& database::percentiles() const {
+    return _percentiles;
+}
+
+const user_leaderboards& database::leaderboards() const {
+    return _leaderboards;
+}
+
+const distinct_sketches& database::sketches() const {
+    return _sketches;
+}
+
+search_result database::search(const tag_query& query, size_t max_ids) const {
+    auto begin = steady_clock::now();
+
+    posting_list matches = _match(query);
+
+    auto matched = steady_clock::now();
+
+    search_result res;
+    res.posts = matches.size();
+
+    std::span<const int32_t> ids = _posts.ids();
+    std::span<const int32_t> uploader_ids = _posts.uploader_ids();
+
+    db_map_type<int32_t, int32_t> users;
+    matches.view().for_each([&](post_row row) {
+        if (res.post_ids.size() < max_ids) {
+            res.post_ids.push_back(ids[row]);
+        }
+
+        users[uploader_ids[row]] += 1;
+    });
+
+    res.users.reserve(users.size());
+    for (const auto& [user_id, posts] : users) {
+        res.users.push_back({ user_id, posts });
+    }
+
+    std::ranges::sort(res.users, {}, &user_count::user_id);
+
+    /* Count the tags of every container of matches separately and reduce those, like the global counts */
+    posting_view view = matches.view();
+    size_t chunks = view.containers().size();
+
+    tag_type_array<std::vector<tag_count_map>> partial;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        partial[type].resize(chunks);
+    }
+
+    _pool.parallel_for(chunks, [&](size_t i) {
+        view.chunk(i).for_each([&](post_row row) {
+            for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                tag_count_map& counts = partial[type][i];
+                for (tag_id tag : _posts.tags(type)[row]) {
+                    counts[tag] += 1;
+                }
+            }
+        });
+    });
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        if (!partial[type].empty()) {
+            tree_reduce(_pool, partial[type]);
+            res.tag_counts[type] = sorted_counts(partial[type].front());
+        }
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::debug("Matched {} posts in {}, counted in {}", res.posts, matched - begin, end - matched);
+
+    return res;
+}
+
+std::optional<tag_id> database::find_tag(std::string_view name) const {
+    return _tags.find(name);
+}
+
+std::string_view database::tag_name(tag_id id) const {
+    return _tags.name(id);
+}
@@ -0,0 +1,628 @@
+#include "database_set.h"
+
+#include "snapshot.h"
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+using std::chrono::steady_clock;
+
+/* Drop the least recently used entries that are done building, until there's room for another.
+ * Returns false if there isn't, because all of them are still being built.
+ */
+template <typename Map, typename Ready>
+[[nodiscard]] static bool make_room(Map& merged, size_t max_entries, Ready&& ready) {
+    while (merged.size() >= max_entries) {
+        auto oldest = merged.end();
+        for (auto it = merged.begin(); it != merged.end(); ++it) {
+            if (ready(it->second.value) && (oldest == merged.end() || it->second.last_used < oldest->second.last_used)) {
+                oldest = it;
+            }
+        }
+
+        if (oldest == merged.end()) {
+            return false;
+        }
+
+        /* Anyone still using it keeps their reference */
+        merged.erase(oldest);
+    }
+
+    return true;
+}
+
+/* Shared by all instances, so a reloaded dataset never reuses a version */
+static std::atomic<uint64_t> next_version { 1 };
+
+/* k-way merge of count arrays sorted by tag, summing the counts of tags present in several */
+[[nodiscard]] static std::vector<tag_count> merge_counts(std::span<const std::span<const tag_count>> inputs) {
+    std::vector<tag_count> res;
+
+    if (inputs.size() == 1) {
+        res.assign(inputs.front().begin(), inputs.front().end());
+        return res;
+    }
+
+    /* At least as many tags as the largest input */
+    size_t largest = 0;
+    for (std::span<const tag_count> input : inputs) {
+        largest = std::max(largest, input.size());
+    }
+
+    res.reserve(largest);
+
+    /* (tag, input) of the next entry of every input, smallest tag first */
+    using head = std::pair<tag_id, size_t>;
+    std::priority_queue<head, std::vector<head>, std::greater<>> heads;
+    std::vector<size_t> positions(inputs.size());
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (!inputs[i].empty()) {
+            heads.emplace(inputs[i].front().tag, i);
+        }
+    }
+
+    while (!heads.empty()) {
+        auto [tag, input] = heads.top();
+        heads.pop();
+
+        int32_t count = inputs[input][positions[input]].count;
+        if (!res.empty() && res.back().tag == tag) {
+            res.back().count += count;
+        } else {
+            res.push_back({ tag, count });
+        }
+
+        if (++positions[input] < inputs[input].size()) {
+            heads.emplace(inputs[input][positions[input]].tag, input);
+        }
+    }
+
+    return res;
+}
+
+database_set::database_set(const std::map<int, std::string>& paths, const database_options& options)
+    : _context { std::make_shared<database_context>(options.worker_threads, options.tag_catalog) } {
+    check_paths(paths);
+
+    /* The budget is for all years together */
+    database_options year_options = options;
+    year_options.cache_budget = options.cache_budget / paths.size();
+
+    for (const auto& [year, path] : paths) {
+        if (options.stop.stop_requested()) {
+            throw load_stopped { "Loading was stopped" };
+        }
+
+        spdlog::info("Loading {} from {}", year, path);
+
+        _years.emplace(year, std::make_unique<database>(path, year_options, _context));
+    }
+
+    auto begin = steady_clock::now();
+
+    uint64_t bit = 1;
+    for (const auto& [year, db] : _years) {
+        for (int32_t id : db->users()) {
+            _user_years[id] |= bit;
+        }
+
+        bit <<= 1;
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Indexed {} users over {} years in {}", _user_years.size(), _years.size(), end - begin);
+
+    /* All years is what's requested by default */
+    if (_years.size() > 1) {
+        std::scoped_lock lock { _merged_lock };
+        if (options.user_percentiles) {
+            (void) _merged_percentiles_for(all_years());
+        }
+
+        (void) _merged_leaderboards_for(all_years());
+    }
+
+    _version = next_version.fetch_add(1);
+}
+
+void database_set::check_paths(const std::map<int, std::string>& paths) {
+    if (paths.empty()) {
+        throw std::invalid_argument { "No databases given" };
+    }
+
+    if (paths.size() > 64) {
+        throw std::invalid_argument { std::format("Too many years ({}), at most 64 are supported", paths.size()) };
+    }
+
+    for (auto it = std::next(paths.begin()); it != paths.end(); ++it) {
+        if (snapshot_reader::is_snapshot(it->second)) {
+            throw std::invalid_argument { std::format("{} is a snapshot, but only the earliest year ({}) can be one, load it from SQLite instead",
+                it->second, paths.begin()->first) };
+        }
+    }
+}
+
+std::shared_lock<std::shared_mutex> database_set::read_lock() const {
+    return std::shared_lock { _context->lock };
+}
+
+void database_set::apply(std::span<const post_version> versions) {
+    std::unique_lock lock { _context->lock };
+
+    {
+        /* They read the tags we're about to change */
+        std::scoped_lock merged_lock { _merged_lock };
+        for (const auto& [range, percentiles] : _merged_percentiles) {
+            percentiles.value->wait();
+        }
+
+        for (const auto& [range, leaderboards] : _merged_leaderboards) {
+            leaderboards.value->wait();
+        }
+    }
+
+    /* Every post is only in one year, the others skip it */
+    for (auto& [year, db] : _years) {
+        db->_apply(versions);
+    }
+
+    std::scoped_lock merged_lock { _merged_lock };
+    _merged_rankings.clear();
+
+    _version = next_version.fetch_add(1);
+}
+
+uint64_t database_set::version() const {
+    return _version;
+}
+
+std::vector<int> database_set::years() const {
+    std::vector<int> res;
+    for (const auto& [year, db] : _years) {
+        res.push_back(year);
+    }
+
+    return res;
+}
+
+year_range database_set::all_years() const {
+    return { _years.begin()->first, _years.rbegin()->first };
+}
+
+bool database_set::contains(const year_range& range) const {
+    return range.first <= range.last && _years.lower_bound(range.first) != _years.upper_bound(range.last);
+}
+
+year_range database_set::clamp(const year_range& range) const {
+    if (!contains(range)) {
+        throw std::out_of_range(std::format("no years in {} to {}", range.first, range.last));
+    }
+
+    return { _years.lower_bound(range.first)->first, std::prev(_years.upper_bound(range.last))->first };
+}
+
+database& database_set::year(int year) {
+    return *_years.at(year);
+}
+
+const database& database_set::year(int year) const {
+    return *_years.at(year);
+}
+
+bool database_set::has_user(int32_t id) const {
+    return _user_years.contains(id);
+}
+
+merged_user_stats database_set::stats_for(int32_t id, const year_range& range) {
+    auto it = _user_years.find(id);
+    if (it == _user_years.end() || (it->second & _year_mask(range)) == 0) {
+        throw std::out_of_range(std::format("user #{} not found in {} to {}", id, range.first, range.last));
+    }
+
+    uint64_t years = it->second;
+
+    /* Keep the per-year stats alive until they're merged */
+    std::vector<std::shared_ptr<const user_stats>> stats;
+
+    uint64_t bit = 1;
+    for (auto& [year, db] : _years) {
+        if (year >= range.first && year <= range.last && (years & bit)) {
+            stats.push_back(db->stats_for(id));
+        }
+
+        bit <<= 1;
+    }
+
+    merged_user_stats res;
+    for (const auto& year_stats : stats) {
+        res.posts += year_stats->posts().size();
+    }
+
+    auto by_count = [](const tag_count& l, const tag_count& r) {
+        return (l.count != r.count) ? (l.count > r.count) : (l.tag < r.tag);
+    };
+
+    std::vector<std::span<const tag_count>> inputs;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        inputs.clear();
+        for (const auto& year_stats : stats) {
+            inputs.push_back(year_stats->tag_count(type));
+        }
+
+        res.tag_counts[type] = merge_counts(inputs);
+
+        /* A single year has it's top ordered already */
+        if (stats.size() == 1) {
+            auto top = stats.front()->top_tags(type);
+            res.top_tags[type].assign(top.begin(), top.end());
+        } else {
+            auto& top = res.top_tags[type];
+            top = res.tag_counts[type];
+
+            size_t limit = std::min(user_stats::top_size, top.size());
+            std::ranges::partial_sort(top, top.begin() + limit, by_count);
+            top.resize(limit);
+        }
+    }
+
+    return res;
+}
+
+std::vector<tag_count> database_set::tag_counts(tag_type type, const year_range& range) const {
+    std::vector<std::span<const tag_count>> inputs;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        inputs.push_back(it->second->tag_counts(type));
+    }
+
+    return merge_counts(inputs);
+}
+
+std::shared_ptr<const tag_ranking> database_set::tag_rankings(tag_type type, const year_range& range) const {
+    year_range years = clamp(range);
+
+    /* A single year is ranked already, and lives as long as we do */
+    if (years.single()) {
+        return { &_years.at(years.first)->tag_rankings(type), [](const tag_ranking*) { } };
+    }
+
+    using ranking_future = std::shared_future<std::shared_ptr<const tag_ranking>>;
+
+    std::tuple key { type, years.first, years.last };
+    std::promise<std::shared_ptr<const tag_ranking>> promise;
+    ranking_future ranking;
+    {
+        std::scoped_lock lock { _merged_lock };
+
+        if (auto it = _merged_rankings.find(key); it != _merged_rankings.end()) {
+            it->second.last_used = ++_merged_clock;
+            ranking = it->second.value;
+        } else {
+            auto ready = [](const ranking_future& ranking) {
+                return ranking.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready && ranking.get()->ready();
+            };
+
+            if (!make_room(_merged_rankings, max_merged_ranges * magic_enum::enum_count<tag_type>(), ready)) {
+                throw not_ready { "Too many ranges of years are being ranked" };
+            }
+
+            _merged_rankings.emplace(key, merged_entry<ranking_future> { promise.get_future().share(), ++_merged_clock });
+        }
+    }
+
+    /* Someone else is building it, only requests for the same range wait for that */
+    if (ranking.valid()) {
+        return ranking.get();
+    }
+
+    try {
+        auto begin = steady_clock::now();
+
+        /* Merging the per-year counts avoids counting all posts again */
+        auto built = std::make_shared<tag_ranking>();
+        built->build(tag_counts(type, years), _context->tags.size(), _context->pool);
+
+        auto end = steady_clock::now();
+
+        spdlog::info("Merged {} rankings for {} to {} in {}", magic_enum::enum_name(type), years.first, years.last, end - begin);
+
+        promise.set_value(built);
+        return built;
+    } catch (...) {
+        /* Anyone waiting gets the exception, the next request tries again */
+        {
+            std::scoped_lock lock { _merged_lock };
+            _merged_rankings.erase(key);
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+std::vector<tag_count> database_set::related_tags(tag_id tag, tag_type type, const year_range& range, size_t limit) const {
+    std::vector<std::vector<tag_count>> years;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        years.push_back(it->second->related_tags(tag, type));
+    }
+
+    std::vector<std::span<const tag_count>> inputs { years.begin(), years.end() };
+    std::vector<tag_count> res = merge_counts(inputs);
+
+    auto by_count = [](const tag_count& l, const tag_count& r) {
+        return (l.count != r.count) ? (l.count > r.count) : (l.tag < r.tag);
+    };
+
+    limit = std::min(limit, res.size());
+    std::ranges::partial_sort(res, res.begin() + limit, by_count);
+    res.resize(limit);
+
+    return res;
+}
+
+bool database_set::related_tags_exact(tag_id tag, const year_range& range) const {
+    year_range years = clamp(range);
+
+    /* The pairs a single year keeps are counted exactly */
+    if (years.single()) {
+        return true;
+    }
+
+    for (auto it = _years.lower_bound(years.first); it != _years.upper_bound(years.last); ++it) {
+        if (it->second->related_tags_pruned(tag)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::shared_ptr<const user_percentiles> database_set::percentiles(const year_range& range) const {
+    year_range years = clamp(range);
+
+    /* A single year is counted already, and lives as long as we do */
+    if (years.single()) {
+        return { &_years.at(years.first)->percentiles(), [](const user_percentiles*) { } };
+    }
+
+    std::scoped_lock lock { _merged_lock };
+    return _merged_percentiles_for(years);
+}
+
+std::shared_ptr<const user_leaderboards> database_set::leaderboards(const year_range& range) const {
+    year_range years = clamp(range);
+
+    /* A single year is ranked already, and lives as long as we do */
+    if (years.single()) {
+        return { &_years.at(years.first)->leaderboards(), [](const user_leaderboards*) { } };
+    }
+
+    std::scoped_lock lock { _merged_lock };
+    return _merged_leaderboards_for(years);
+}
+
+hyperloglog database_set::distinct_tags(std::span<const int32_t> users, tag_type type, const year_range& range) const {
+    /* Sketches merge losslessly, so years are just more sketches */
+    hyperloglog res;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        for (int32_t user_id : users) {
+            if (const hyperloglog* sketch = it->second->sketches().user_tags(user_id, type)) {
+                res.merge(*sketch);
+            }
+        }
+    }
+
+    return res;
+}
+
+hyperloglog database_set::distinct_users(std::span<const tag_id> tags, const year_range& range) const {
+    hyperloglog res;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        for (tag_id tag : tags) {
+            if (const hyperloglog* sketch = it->second->sketches().tag_users(tag)) {
+                res.merge(*sketch);
+            }
+        }
+    }
+
+    return res;
+}
+
+std::vector<aggregate_row> database_set::aggregate(const aggregate_query& query, const year_range& range) const {
+    std::vector<std::vector<aggregate_row>> years;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        years.push_back(::aggregate(it->second->posts(), query, _context->pool));
+    }
+
+    if (years.size() == 1) {
+        return std::move(years.front());
+    }
+
+    return merge_aggregates(years);
+}
+
+search_result database_set::search(const tag_query& query, const year_range& range, size_t max_ids) const {
+    search_result res;
+
+    std::vector<search_result> years;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        search_result& year = years.emplace_back(it->second->search(query, max_ids - res.post_ids.size()));
+
+        res.posts += year.posts;
+        res.post_ids.insert(res.post_ids.end(), year.post_ids.begin(), year.post_ids.end());
+    }
+
+    if (years.size() == 1) {
+        res.users = std::move(years.front().users);
+        res.tag_counts = std::move(years.front().tag_counts);
+        return res;
+    }
+
+    db_map_type<int32_t, int32_t> users;
+    for (const search_result& year : years) {
+        for (const auto& [user_id, posts] : year.users) {
+            users[user_id] += posts;
+        }
+    }
+
+    res.users.reserve(users.size());
+    for (const auto& [user_id, posts] : users) {
+        res.users.push_back({ user_id, posts });
+    }
+
+    std::ranges::sort(res.users, {}, &user_count::user_id);
+
+    std::vector<std::span<const tag_count>> inputs;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        inputs.clear();
+        for (const search_result& year : years) {
+            inputs.push_back(year.tag_counts[type]);
+        }
+
+        res.tag_counts[type] = merge_counts(inputs);
+    }
+
+    return res;
+}
+
+std::optional<tag_id> database_set::find_tag(std::string_view name) const {
+    return _context->tags.find(name);
+}
+
+std::string_view database_set::tag_name(tag_id id) const {
+    return _context->tags.name(id);
+}
+
+user_cache::counters database_set::cache_stats() const {
+    user_cache::counters res {};
+    for (const auto& [year, db] : _years) {
+        auto counters = db->cache_stats();
+        res.hits += counters.hits;
+        res.misses += counters.misses;
+        res.evictions += counters.evictions;
+        res.entries += counters.entries;
+        res.bytes += counters.bytes;
+        res.budget += counters.budget;
+    }
+
+    return res;
+}
+
+std::vector<memory_entry> database_set::memory_report() const {
+    std::vector<memory_entry> res;
+    res.push_back({ "tag_dictionary", _context->tags.footprint() });
+    res.push_back({ "user_years", { .owned = map_bytes(_user_years) } });
+
+    for (const auto& [year, db] : _years) {
+        for (auto& [name, footprint] : db->memory_report(false)) {
+            res.push_back({ std::format("{}.{}", year, name), footprint });
+        }
+    }
+
+    std::scoped_lock lock { _merged_lock };
+
+    memory_footprint merged { .owned = node_container_bytes(_merged_rankings) };
+    for (const auto& [key, ranking] : _merged_rankings) {
+        /* Still being built otherwise */
+        if (ranking.value.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready) {
+            merged += ranking.value.get()->footprint();
+        }
+    }
+
+    res.push_back({ "merged_rankings", merged });
+
+    memory_footprint percentiles { .owned = node_container_bytes(_merged_percentiles) };
+    for (const auto& [range, year_percentiles] : _merged_percentiles) {
+        percentiles += year_percentiles.value->footprint();
+    }
+
+    res.push_back({ "merged_percentiles", percentiles });
+
+    memory_footprint leaderboards { .owned = node_container_bytes(_merged_leaderboards) };
+    for (const auto& [range, range_leaderboards] : _merged_leaderboards) {
+        leaderboards += range_leaderboards.value->footprint();
+    }
+
+    res.push_back({ "merged_leaderboards", leaderboards });
+
+    return res;
+}
+
+uint64_t database_set::_year_mask(const year_range& range) const {
+    uint64_t res = 0;
+
+    uint64_t bit = 1;
+    for (const auto& [year, db] : _years) {
+        if (year >= range.first && year <= range.last) {
+            res |= bit;
+        }
+
+        bit <<= 1;
+    }
+
+    return res;
+}
+
+std::shared_ptr<user_percentiles> database_set::_merged_percentiles_for(const year_range& range) const {
+    std::pair key { range.first, range.last };
+    if (auto it = _merged_percentiles.find(key); it != _merged_percentiles.end()) {
+        it->second.last_used = ++_merged_clock;
+        return it->second.value;
+    }
+
+    auto ready = [](const std::shared_ptr<user_percentiles>& percentiles) { return percentiles->ready(); };
+    if (!make_room(_merged_percentiles, max_merged_ranges, ready)) {
+        throw not_ready { "Too many ranges of years are being counted" };
+    }
+
+    /* Built in the background, the first standing_of waits for it */
+    std::vector<user_percentiles::source> sources;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        sources.push_back({ &it->second->_posts, &it->second->_index });
+    }
+
+    auto percentiles = std::make_shared<user_percentiles>();
+    percentiles->build(std::move(sources), _context->tags.size(), _context->pool);
+
+    spdlog::info("Counting users of every tag for {} to {}", range.first, range.last);
+
+    _merged_percentiles.emplace(key, merged_entry<std::shared_ptr<user_percentiles>> { percentiles, ++_merged_clock });
+
+    return percentiles;
+}
+
+std::shared_ptr<user_leaderboards> database_set::_merged_leaderboards_for(const year_range& range) const {
+    std::pair key { range.first, range.last };
+    if (auto it = _merged_leaderboards.find(key); it != _merged_leaderboards.end()) {
+        it->second.last_used = ++_merged_clock;
+        return it->second.value;
+    }
+
+    auto ready = [](const std::shared_ptr<user_leaderboards>& leaderboards) { return leaderboards->ready(); };
+    if (!make_room(_merged_leaderboards, max_merged_ranges, ready)) {
+        throw not_ready { "Too many ranges of years are being ranked" };
+    }
+
+    /* Unique tags can't be summed over years, so users are counted over the posts of all of them */
+    std::vector<user_leaderboards::source> sources;
+    for (auto it = _years.lower_bound(range.first); it != _years.upper_bound(range.last); ++it) {
+        user_leaderboards::source& source = sources.emplace_back(user_leaderboards::source { .posts = &it->second->_posts });
+        for (const auto& [uploader_id, posts] : it->second->_user_posts) {
+            source.users.emplace_back(uploader_id, posts.span());
+        }
+    }
+
+    auto leaderboards = std::make_shared<user_leaderboards>();
+    leaderboards->build(std::move(sources), _context->pool);
+
+    spdlog::info("Ranking users for {} to {}", range.first, range.last);
+
+    _merged_leaderboards.emplace(key, merged_entry<std::shared_ptr<user_leaderboards>> { leaderboards, ++_merged_clock });
+
+    return leaderboards;
+}
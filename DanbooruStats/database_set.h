@@ -0,0 +1,154 @@
+#ifndef DATABASE_SET_H
+#define DATABASE_SET_H
+
+#include "database.h"
+#include "post_aggregation.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+/* Range of years, inclusive */
+struct year_range {
+    int first;
+    int last;
+
+    [[nodiscard]] bool single() const { return first == last; }
+
+    auto operator<=>(const year_range&) const = default;
+};
+
+/* Everything a user did in a range of years */
+struct merged_user_stats {
+    size_t posts = 0;
+
+    /* Sorted by tag ID */
+    tag_type_array<std::vector<tag_count>> tag_counts;
+
+    /* Up to user_stats::top_size tags by count descending */
+    tag_type_array<std::vector<tag_count>> top_tags;
+};
+
+/* Several yearly databases as shards of one dataset. They share a tag dictionary (so tag IDs
+ * mean the same in every year), a thread pool and a lock. Queries go to a single year, or are
+ * merged over a range of years from the per-year results.
+ */
+class database_set {
+    std::shared_ptr<database_context> _context;
+
+    std::map<int, std::unique_ptr<database>> _years;
+
+    /* Years every user has posts in, bit i is the i-th year in _years */
+    db_map_type<int32_t, uint64_t> _user_years;
+
+    /* Results merged over several years, by ranges clamped to the loaded years. At most
+     * max_merged_ranges of each are kept, the least recently used going first once they're built.
+     */
+    template <typename T>
+    struct merged_entry {
+        T value;
+        uint64_t last_used = 0;
+    };
+
+    /* Merged rankings are kept until the counts change */
+    mutable std::mutex _merged_lock;
+    mutable uint64_t _merged_clock = 0;
+    mutable std::map<std::tuple<tag_type, int, int>, merged_entry<std::shared_future<std::shared_ptr<const tag_ranking>>>> _merged_rankings;
+
+    /* Counting users again is expensive, so these are kept as built */
+    mutable std::map<std::pair<int, int>, merged_entry<std::shared_ptr<user_percentiles>>> _merged_percentiles;
+    mutable std::map<std::pair<int, int>, merged_entry<std::shared_ptr<user_leaderboards>>> _merged_leaderboards;
+
+    std::atomic<uint64_t> _version { 0 };
+
+    public:
+    static constexpr size_t max_merged_ranges = 8;
+
+    /* Up to 64 years, loaded one after another as they share the tag dictionary, see check_paths */
+    explicit database_set(const std::map<int, std::string>& paths, const database_options& options = {});
+
+    /* Throws std::invalid_argument if paths can't be loaded together. A snapshot maps the tag IDs it was
+     * written with, so only the earliest year can be one, the others are loaded from SQLite on top of it.
+     */
+    static void check_paths(const std::map<int, std::string>& paths);
+
+    [[nodiscard]] std::shared_lock<std::shared_mutex> read_lock() const;
+
+    /* Apply versions to whichever year their posts are in, see database::apply */
+    void apply(std::span<const post_version> versions);
+
+    /* Changes whenever counts change, and is larger for every new instance and every apply */
+    [[nodiscard]] uint64_t version() const;
+
+    /* All years, ascending */
+    [[nodiscard]] std::vector<int> years() const;
+    [[nodiscard]] year_range all_years() const;
+    [[nodiscard]] bool contains(const year_range& range) const;
+
+    /* The first and last loaded years in range, throws std::out_of_range if there are none */
+    [[nodiscard]] year_range clamp(const year_range& range) const;
+
+    [[nodiscard]] database& year(int year);
+    [[nodiscard]] const database& year(int year) const;
+
+    [[nodiscard]] bool has_user(int32_t id) const;
+
+    /* Throws std::out_of_range if the user has no posts in range */
+    [[nodiscard]] merged_user_stats stats_for(int32_t id, const year_range& range);
+
+    /* Sorted by tag ID */
+    [[nodiscard]] std::vector<tag_count> tag_counts(tag_type type, const year_range& range) const;
+    /* Merged rankings are built by the first request for them, outside of any lock shared with other
+     * ranges. Throws not_ready if too many other ranges are still being ranked.
+     */
+    [[nodiscard]] std::shared_ptr<const tag_ranking> tag_rankings(tag_type type, const year_range& range) const;
+
+    /* Up to limit tags of a category seen most often on the same posts as tag, summed over the years.
+     * Throws not_ready while any year is still counting them.
+     */
+    [[nodiscard]] std::vector<tag_count> related_tags(tag_id tag, tag_type type, const year_range& range, size_t limit) const;
+
+    /* Whether related_tags counts every post of tag in range. Years prune the related tags of their
+     * heaviest tags before they're summed, so pairs pruned in some years are counted low or left out.
+     */
+    [[nodiscard]] bool related_tags_exact(tag_id tag, const year_range& range) const;
+
+    /* Standing of users among the users of every tag, counting all posts in range.
+     * Throws not_ready if too many other ranges are still being counted.
+     */
+    [[nodiscard]] std::shared_ptr<const user_percentiles> percentiles(const year_range& range) const;
+
+    /* Users ranked by posts and unique tags in range */
+    [[nodiscard]] std::shared_ptr<const user_leaderboards> leaderboards(const year_range& range) const;
+
+    /* Sketch of the distinct tags of a category the users used in range */
+    [[nodiscard]] hyperloglog distinct_tags(std::span<const int32_t> users, tag_type type, const year_range& range) const;
+
+    /* Sketch of the distinct users who uploaded posts with any of the tags in range */
+    [[nodiscard]] hyperloglog distinct_users(std::span<const tag_id> tags, const year_range& range) const;
+
+    /* Posts in range grouped by one or two columns, see aggregate */
+    [[nodiscard]] std::vector<aggregate_row> aggregate(const aggregate_query& query, const year_range& range) const;
+
+    /* Posts matching a query in range, with the IDs of up to max_ids of them, earliest years first */
+    [[nodiscard]] search_result search(const tag_query& query, const year_range& range, size_t max_ids) const;
+
+    [[nodiscard]] std::optional<tag_id> find_tag(std::string_view name) const;
+    [[nodiscard]] std::string_view tag_name(tag_id id) const;
+
+    [[nodiscard]] user_cache::counters cache_stats() const;
+    [[nodiscard]] std::vector<memory_entry> memory_report() const;
+
+    private:
+    /* Bits in _user_years for the years in range */
+    [[nodiscard]] uint64_t _year_mask(const year_range& range) const;
+
+    /* percentiles for several (clamped) years, requires _merged_lock */
+    [[nodiscard]] std::shared_ptr<user_percentiles> _merged_percentiles_for(const year_range& range) const;
+
+    /* leaderboards for several (clamped) years, requires _merged_lock */
+    [[nodiscard]] std::shared_ptr<user_leaderboards> _merged_leaderboards_for(const year_range& range) const;
+};
+
+#endif /* DATABASE_SET_H */
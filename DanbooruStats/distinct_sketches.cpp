@@ -0,0 +1,159 @@
+#include "distinct_sketches.h"
+
+#include "thread_pool.h"
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <memory>
+
+using std::chrono::steady_clock;
+
+distinct_sketches::~distinct_sketches() {
+    /* The pool may still be referring to us */
+    if (_complete.valid()) {
+        _complete.wait();
+    }
+}
+
+void distinct_sketches::build(const post_table& posts, const posting_index& index, std::vector<std::pair<int32_t, std::span<const post_row>>> users, size_t tags, thread_pool& pool) {
+    wait();
+
+    auto promise = std::make_shared<std::promise<void>>();
+    _complete = promise->get_future().share();
+
+    pool.submit([this, &posts, &index, users = std::move(users), tags, &pool, promise] {
+        try {
+            _build(posts, index, users, tags, pool);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+const hyperloglog* distinct_sketches::user_tags(int32_t user_id, tag_type type) const {
+    wait();
+
+    auto it = _user_slots.find(user_id);
+    if (it == _user_slots.end()) {
+        return nullptr;
+    }
+
+    return &_user_tags[it->second][type];
+}
+
+const hyperloglog* distinct_sketches::tag_users(tag_id tag) const {
+    wait();
+
+    auto it = _tag_slots.find(tag);
+    if (it == _tag_slots.end()) {
+        return nullptr;
+    }
+
+    return &_tag_users[it->second];
+}
+
+void distinct_sketches::add(int32_t user_id, tag_type type, tag_id tag) {
+    wait();
+
+    auto [it, inserted] = _user_slots.try_emplace(user_id, static_cast<uint32_t>(_user_tags.size()));
+    if (inserted) {
+        _user_tags.emplace_back();
+    }
+
+    _user_tags[it->second][type].add(hyperloglog::hash(tag));
+
+    auto [tag_it, tag_inserted] = _tag_slots.try_emplace(tag, static_cast<uint32_t>(_tag_users.size()));
+    if (tag_inserted) {
+        _tag_users.emplace_back();
+    }
+
+    _tag_users[tag_it->second].add(hyperloglog::hash(static_cast<uint32_t>(user_id)));
+}
+
+memory_footprint distinct_sketches::footprint() const {
+    /* Nothing is there until it's built */
+    if (!_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready) {
+        return {};
+    }
+
+    memory_footprint res {
+        .owned = map_bytes(_user_slots) + (_user_tags.capacity() * sizeof(tag_type_array<hyperloglog>)) + map_bytes(_tag_slots) + (_tag_users.capacity() * sizeof(hyperloglog)),
+    };
+
+    for (const auto& sketches : _user_tags) {
+        for (const hyperloglog& sketch : sketches) {
+            res.owned += sketch.memory_usage();
+        }
+    }
+
+    for (const hyperloglog& sketch : _tag_users) {
+        res.owned += sketch.memory_usage();
+    }
+
+    return res;
+}
+
+void distinct_sketches::wait() const {
+    if (_complete.valid()) {
+        _complete.get();
+    }
+}
+
+void distinct_sketches::_build(const post_table& posts, const posting_index& index, std::span<const std::pair<int32_t, std::span<const post_row>>> users, size_t tags, thread_pool& pool) {
+    auto begin = steady_clock::now();
+
+    flat_hash_map<int32_t, uint32_t> user_slots;
+    user_slots.reserve(users.size());
+    for (uint32_t slot = 0; slot < users.size(); ++slot) {
+        user_slots.emplace(users[slot].first, slot);
+    }
+
+    std::vector<tag_type_array<hyperloglog>> user_tags(users.size());
+    pool.parallel_for(users.size(), [&](size_t slot) {
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            const tag_column& column = posts.tags(type);
+            hyperloglog& sketch = user_tags[slot][type];
+
+            for (post_row row : users[slot].second) {
+                for (tag_id tag : column[row]) {
+                    sketch.add(hyperloglog::hash(tag));
+                }
+            }
+        }
+    }, 64);
+
+    std::span<const int32_t> uploader_ids = posts.uploader_ids();
+
+    std::vector<tag_id> used;
+    for (tag_id tag = 0; tag < tags; ++tag) {
+        if (!index[tag].empty()) {
+            used.push_back(tag);
+        }
+    }
+
+    flat_hash_map<tag_id, uint32_t> tag_slots;
+    tag_slots.reserve(used.size());
+    for (uint32_t slot = 0; slot < used.size(); ++slot) {
+        tag_slots.emplace(used[slot], slot);
+    }
+
+    std::vector<hyperloglog> tag_users(used.size());
+    pool.parallel_for(used.size(), [&](size_t slot) {
+        hyperloglog& sketch = tag_users[slot];
+        index[used[slot]].for_each([&](post_row row) {
+            sketch.add(hyperloglog::hash(static_cast<uint32_t>(uploader_ids[row])));
+        });
+    }, 1024);
+
+    /* Nobody looks at these until we're done */
+    _user_slots = std::move(user_slots);
+    _user_tags = std::move(user_tags);
+    _tag_slots = std::move(tag_slots);
+    _tag_users = std::move(tag_users);
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Sketched {} users and {} tags in {}", _user_tags.size(), _tag_users.size(), end - begin);
+}
@@ -0,0 +1,63 @@
+#ifndef DISTINCT_SKETCHES_H
+#define DISTINCT_SKETCHES_H
+
+#include "flat_hash_map.h"
+#include "hyperloglog.h"
+#include "memory_footprint.h"
+#include "post_table.h"
+#include "posting_index.h"
+
+#include <cstdint>
+#include <future>
+#include <span>
+#include <utility>
+#include <vector>
+
+class thread_pool;
+
+/* HyperLogLog sketches of the distinct tags of every category per user, and of the distinct
+ * uploaders per tag. Merging the sketches of any set of users or tags estimates how many
+ * distinct values they have together, without merging their counts.
+ * Built on the pool, applied versions only add to them.
+ */
+class distinct_sketches {
+    flat_hash_map<int32_t, uint32_t> _user_slots;
+    std::vector<tag_type_array<hyperloglog>> _user_tags;
+
+    /* Only tags used in this dataset, most of the catalog never is */
+    flat_hash_map<tag_id, uint32_t> _tag_slots;
+    std::vector<hyperloglog> _tag_users;
+
+    std::shared_future<void> _complete;
+
+    public:
+    distinct_sketches() = default;
+    ~distinct_sketches();
+
+    distinct_sketches(const distinct_sketches&) = delete;
+    distinct_sketches& operator=(const distinct_sketches&) = delete;
+
+    /* Sketch the posts of every user and the first tags tags of the index in the background.
+     * The posts and index must outlive this.
+     */
+    void build(const post_table& posts, const posting_index& index, std::vector<std::pair<int32_t, std::span<const post_row>>> users, size_t tags, thread_pool& pool);
+
+    /* Distinct tags of a category of a user, nullptr if they have no posts */
+    [[nodiscard]] const hyperloglog* user_tags(int32_t user_id, tag_type type) const;
+
+    /* Distinct uploaders of a tag, nullptr if nobody used it */
+    [[nodiscard]] const hyperloglog* tag_users(tag_id tag) const;
+
+    /* A user added tag to one of their posts */
+    void add(int32_t user_id, tag_type type, tag_id tag);
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    /* Wait until building is done */
+    void wait() const;
+
+    private:
+    void _build(const post_table& posts, const posting_index& index, std::span<const std::pair<int32_t, std::span<const post_row>>> users, size_t tags, thread_pool& pool);
+};
+
+#endif /* DISTINCT_SKETCHES_H */
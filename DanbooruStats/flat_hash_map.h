@@ -0,0 +1,410 @@
+#ifndef FLAT_HASH_MAP_H
+#define FLAT_HASH_MAP_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/* Hashes anything string-like as a string_view, so std::string keys can be looked up without
+ * constructing a string (same idea as string_hasher in tools/fast_forward_posts.cpp).
+ */
+struct flat_string_hash {
+    using is_transparent = void;
+
+    [[nodiscard]] size_t operator()(std::string_view str) const { return std::hash<std::string_view> {}(str); }
+    [[nodiscard]] size_t operator()(const std::string& str) const { return std::hash<std::string_view> {}(str); }
+    [[nodiscard]] size_t operator()(const char* str) const { return std::hash<std::string_view> {}(str); }
+};
+
+template <typename K>
+using flat_default_hash = std::conditional_t<std::is_convertible_v<const K&, std::string_view>, flat_string_hash, std::hash<K>>;
+
+/* Open-addressing hash map with linear probing, all entries are stored in a single array.
+ *
+ * Every slot has a control byte, which is either 0 (empty) or the high bit plus 7 bits of the
+ * hash, so most mismatches are rejected without touching the entry. Erasing shifts later entries
+ * of the probe sequence back instead of leaving tombstones.
+ *
+ * Unlike std::unordered_map, inserting or erasing invalidates all iterators and references.
+ */
+template <typename K, typename V, typename Hash = flat_default_hash<K>, typename Eq = std::equal_to<>>
+class flat_hash_map {
+    public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+    using size_type = size_t;
+    using hasher = Hash;
+    using key_equal = Eq;
+
+    private:
+    using allocator = std::allocator<value_type>;
+
+    static constexpr size_t min_capacity = 16;
+
+    /* Fibonacci hashing, so weak hashes (like the identity std::hash for integers) still spread */
+    static constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+
+    uint8_t* _ctrl = nullptr;
+    value_type* _slots = nullptr;
+    size_t _capacity = 0;
+    size_t _size = 0;
+
+    /* 64 - log2(_capacity) */
+    int _shift = 64;
+
+    [[no_unique_address]] Hash _hash;
+    [[no_unique_address]] Eq _eq;
+
+    template <bool Const>
+    class basic_iterator {
+        friend class flat_hash_map;
+        template <bool> friend class basic_iterator;
+
+        using map_pointer = std::conditional_t<Const, const flat_hash_map*, flat_hash_map*>;
+
+        map_pointer _map = nullptr;
+        size_t _index = 0;
+
+        basic_iterator(map_pointer map, size_t index) : _map { map }, _index { index } {
+            _skip_empty();
+        }
+
+        void _skip_empty() {
+            while (_index < _map->_capacity && _map->_ctrl[_index] == 0) {
+                ++_index;
+            }
+        }
+
+        public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_hash_map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        basic_iterator() = default;
+
+        /* iterator -> const_iterator */
+        template <bool OtherConst> requires (Const && !OtherConst)
+        basic_iterator(const basic_iterator<OtherConst>& other) : _map { other._map }, _index { other._index } { }
+
+        [[nodiscard]] reference operator*() const { return _map->_slots[_index]; }
+        [[nodiscard]] pointer operator->() const { return &_map->_slots[_index]; }
+
+        basic_iterator& operator++() {
+            ++_index;
+            _skip_empty();
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator res = *this;
+            ++*this;
+            return res;
+        }
+
+        [[nodiscard]] bool operator==(const basic_iterator& other) const { return _index == other._index; }
+    };
+
+    public:
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    flat_hash_map() = default;
+
+    flat_hash_map(const flat_hash_map& other) : _hash { other._hash }, _eq { other._eq } {
+        reserve(other._size);
+        for (const value_type& value : other) {
+            _insert_new(_hash_of(value.first), value);
+        }
+    }
+
+    flat_hash_map(flat_hash_map&& other) noexcept
+        : _ctrl { std::exchange(other._ctrl, nullptr) }
+        , _slots { std::exchange(other._slots, nullptr) }
+        , _capacity { std::exchange(other._capacity, 0) }
+        , _size { std::exchange(other._size, 0) }
+        , _shift { std::exchange(other._shift, 64) }
+        , _hash { other._hash }, _eq { other._eq } {
+
+    }
+
+    flat_hash_map& operator=(const flat_hash_map& other) {
+        if (this != &other) {
+            flat_hash_map copy { other };
+            swap(copy);
+        }
+
+        return *this;
+    }
+
+    flat_hash_map& operator=(flat_hash_map&& other) noexcept {
+        flat_hash_map moved { std::move(other) };
+        swap(moved);
+        return *this;
+    }
+
+    ~flat_hash_map() {
+        _release();
+    }
+
+    void swap(flat_hash_map& other) noexcept {
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_shift, other._shift);
+        std::swap(_hash, other._hash);
+        std::swap(_eq, other._eq);
+    }
+
+    [[nodiscard]] iterator begin() { return { this, 0 }; }
+    [[nodiscard]] iterator end() { return { this, _capacity }; }
+    [[nodiscard]] const_iterator begin() const { return { this, 0 }; }
+    [[nodiscard]] const_iterator end() const { return { this, _capacity }; }
+
+    [[nodiscard]] size_t size() const { return _size; }
+    [[nodiscard]] bool empty() const { return _size == 0; }
+    [[nodiscard]] size_t capacity() const { return _capacity; }
+
+    /* Heap memory used by the table itself, not counting anything the entries own */
+    [[nodiscard]] size_t memory_usage() const { return _capacity * (sizeof(value_type) + 1); }
+
+    /* Make room for count entries without rehashing */
+    void reserve(size_t count) {
+        size_t required = std::bit_ceil(std::max(min_capacity, count + (count / 7) + 1));
+        if (required > _capacity) {
+            _rehash(required);
+        }
+    }
+
+    void clear() {
+        _release();
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] iterator find(const Q& key) {
+        return { this, _find(key) };
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] const_iterator find(const Q& key) const {
+        return { this, _find(key) };
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] bool contains(const Q& key) const {
+        return _find(key) != _capacity;
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] size_t count(const Q& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] V& at(const Q& key) {
+        size_t index = _find(key);
+        if (index == _capacity) {
+            throw std::out_of_range { "flat_hash_map::at" };
+        }
+
+        return _slots[index].second;
+    }
+
+    template <typename Q = K>
+    [[nodiscard]] const V& at(const Q& key) const {
+        size_t index = _find(key);
+        if (index == _capacity) {
+            throw std::out_of_range { "flat_hash_map::at" };
+        }
+
+        return _slots[index].second;
+    }
+
+    V& operator[](const K& key) {
+        return try_emplace(key).first->second;
+    }
+
+    V& operator[](K&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /* Only constructs the value if the key isn't present yet */
+    template <typename Q, typename... Args>
+    std::pair<iterator, bool> try_emplace(Q&& key, Args&&... args) {
+        uint64_t hash = _hash_of(key);
+
+        if (size_t index = _find(key, hash); index != _capacity) {
+            return { iterator { this, index }, false };
+        }
+
+        size_t index = _insert_new(hash, std::piecewise_construct,
+            std::forward_as_tuple(std::forward<Q>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+
+        return { iterator { this, index }, true };
+    }
+
+    template <typename Q, typename... Args>
+    std::pair<iterator, bool> emplace(Q&& key, Args&&... args) {
+        return try_emplace(std::forward<Q>(key), std::forward<Args>(args)...);
+    }
+
+    template <typename Q, typename T>
+    std::pair<iterator, bool> insert_or_assign(Q&& key, T&& value) {
+        auto res = try_emplace(std::forward<Q>(key), std::forward<T>(value));
+        if (!res.second) {
+            res.first->second = std::forward<T>(value);
+        }
+
+        return res;
+    }
+
+    template <typename Q = K>
+    size_t erase(const Q& key) {
+        size_t index = _find(key);
+        if (index == _capacity) {
+            return 0;
+        }
+
+        std::destroy_at(&_slots[index]);
+        _ctrl[index] = 0;
+        --_size;
+
+        /* Shift back entries that were displaced past the erased slot */
+        size_t mask = _capacity - 1;
+        size_t hole = index;
+        for (size_t i = (index + 1) & mask; _ctrl[i] != 0; i = (i + 1) & mask) {
+            size_t home = _home(_hash_of(_slots[i].first));
+
+            /* Only move it if the hole is between it's home and where it is now */
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                std::construct_at(&_slots[hole], std::move(_slots[i]));
+                std::destroy_at(&_slots[i]);
+                _ctrl[hole] = std::exchange(_ctrl[i], 0);
+                hole = i;
+            }
+        }
+
+        return 1;
+    }
+
+    private:
+    template <typename Q>
+    [[nodiscard]] uint64_t _hash_of(const Q& key) const {
+        return static_cast<uint64_t>(_hash(key)) * multiplier;
+    }
+
+    [[nodiscard]] size_t _home(uint64_t hash) const {
+        return static_cast<size_t>(hash >> _shift);
+    }
+
+    [[nodiscard]] static uint8_t _tag(uint64_t hash) {
+        return static_cast<uint8_t>(hash) | 0x80;
+    }
+
+    template <typename Q>
+    [[nodiscard]] size_t _find(const Q& key) const {
+        return _find(key, _hash_of(key));
+    }
+
+    /* Index of the key, or _capacity if it's not present */
+    template <typename Q>
+    [[nodiscard]] size_t _find(const Q& key, uint64_t hash) const {
+        if (_size == 0) {
+            return _capacity;
+        }
+
+        size_t mask = _capacity - 1;
+        uint8_t tag = _tag(hash);
+        for (size_t i = _home(hash); _ctrl[i] != 0; i = (i + 1) & mask) {
+            if (_ctrl[i] == tag && _eq(_slots[i].first, key)) {
+                return i;
+            }
+        }
+
+        return _capacity;
+    }
+
+    /* Insert a key that's known not to be present */
+    template <typename... Args>
+    size_t _insert_new(uint64_t hash, Args&&... args) {
+        /* Keep the load factor at most 7/8 */
+        if ((_size + 1) * 8 > _capacity * 7) {
+            _rehash(std::max(min_capacity, _capacity * 2));
+        }
+
+        size_t mask = _capacity - 1;
+        size_t i = _home(hash);
+        while (_ctrl[i] != 0) {
+            i = (i + 1) & mask;
+        }
+
+        std::construct_at(&_slots[i], std::forward<Args>(args)...);
+        _ctrl[i] = _tag(hash);
+        ++_size;
+
+        return i;
+    }
+
+    void _rehash(size_t capacity) {
+        uint8_t* old_ctrl = std::exchange(_ctrl, new uint8_t[capacity] {});
+        value_type* old_slots = std::exchange(_slots, allocator {}.allocate(capacity));
+        size_t old_capacity = std::exchange(_capacity, capacity);
+
+        _shift = 64 - std::countr_zero(capacity);
+
+        size_t mask = _capacity - 1;
+        for (size_t j = 0; j < old_capacity; ++j) {
+            if (old_ctrl[j] == 0) {
+                continue;
+            }
+
+            size_t i = _home(_hash_of(old_slots[j].first));
+            while (_ctrl[i] != 0) {
+                i = (i + 1) & mask;
+            }
+
+            std::construct_at(&_slots[i], std::move(old_slots[j]));
+            std::destroy_at(&old_slots[j]);
+            _ctrl[i] = old_ctrl[j];
+        }
+
+        if (old_slots) {
+            allocator {}.deallocate(old_slots, old_capacity);
+        }
+
+        delete[] old_ctrl;
+    }
+
+    void _release() {
+        for (size_t i = 0; i < _capacity; ++i) {
+            if (_ctrl[i] != 0) {
+                std::destroy_at(&_slots[i]);
+            }
+        }
+
+        if (_slots) {
+            allocator {}.deallocate(_slots, _capacity);
+        }
+
+        delete[] _ctrl;
+
+        _ctrl = nullptr;
+        _slots = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _shift = 64;
+    }
+};
+
+#endif /* FLAT_HASH_MAP_H */
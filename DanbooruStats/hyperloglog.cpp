@@ -0,0 +1,128 @@
+#include "hyperloglog.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+/* Sparse entries take 4 bytes, so past this many the dense registers are smaller */
+static constexpr size_t max_sparse = hyperloglog::registers / sizeof(uint32_t);
+
+double hyperloglog::relative_error() {
+    return 1.04 / std::sqrt(static_cast<double>(registers));
+}
+
+uint64_t hyperloglog::hash(uint64_t value) {
+    /* splitmix64 finalizer */
+    value += 0x9e3779b97f4a7c15;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+void hyperloglog::add(uint64_t hash) {
+    auto index = static_cast<uint32_t>(hash >> (64 - precision));
+
+    /* Position of the first set bit after the index bits, the all-zero case counts as one past the end */
+    uint64_t rest = hash << precision;
+    auto value = static_cast<uint8_t>(std::min(std::countl_zero(rest), 64 - precision) + 1);
+
+    _set(index, value);
+}
+
+void hyperloglog::merge(const hyperloglog& other) {
+    if (other._dense.empty() && _dense.empty() && (_sparse.size() + other._sparse.size()) <= max_sparse) {
+        for (uint32_t entry : other._sparse) {
+            _set(entry >> 8, static_cast<uint8_t>(entry & 0xff));
+        }
+
+        return;
+    }
+
+    _to_dense();
+
+    if (!other._dense.empty()) {
+        /* Vectorizes */
+        for (size_t i = 0; i < registers; ++i) {
+            _dense[i] = std::max(_dense[i], other._dense[i]);
+        }
+    } else {
+        for (uint32_t entry : other._sparse) {
+            uint8_t& reg = _dense[entry >> 8];
+            reg = std::max(reg, static_cast<uint8_t>(entry & 0xff));
+        }
+    }
+}
+
+double hyperloglog::estimate() const {
+    double sum = 0;
+    size_t zeros = 0;
+
+    if (!_dense.empty()) {
+        for (uint8_t reg : _dense) {
+            sum += std::ldexp(1., -reg);
+            zeros += (reg == 0);
+        }
+    } else {
+        zeros = registers - _sparse.size();
+        sum = static_cast<double>(zeros);
+        for (uint32_t entry : _sparse) {
+            sum += std::ldexp(1., -static_cast<int>(entry & 0xff));
+        }
+    }
+
+    auto m = static_cast<double>(registers);
+    double alpha = 0.7213 / (1. + (1.079 / m));
+    double raw = alpha * m * m / sum;
+
+    /* Linear counting is more accurate while many registers are still empty */
+    if (raw <= 2.5 * m && zeros > 0) {
+        return m * std::log(m / static_cast<double>(zeros));
+    }
+
+    return raw;
+}
+
+bool hyperloglog::empty() const {
+    return _sparse.empty() && _dense.empty();
+}
+
+size_t hyperloglog::memory_usage() const {
+    return (_sparse.capacity() * sizeof(uint32_t)) + _dense.capacity();
+}
+
+void hyperloglog::_set(uint32_t index, uint8_t value) {
+    if (!_dense.empty()) {
+        _dense[index] = std::max(_dense[index], value);
+        return;
+    }
+
+    auto it = std::ranges::lower_bound(_sparse, index, {}, [](uint32_t entry) { return entry >> 8; });
+    if (it != _sparse.end() && (*it >> 8) == index) {
+        if ((*it & 0xff) < value) {
+            *it = (index << 8) | value;
+        }
+
+        return;
+    }
+
+    if (_sparse.size() < max_sparse) {
+        _sparse.insert(it, (index << 8) | value);
+        return;
+    }
+
+    _to_dense();
+    _dense[index] = value;
+}
+
+void hyperloglog::_to_dense() {
+    if (!_dense.empty()) {
+        return;
+    }
+
+    _dense.assign(registers, 0);
+    for (uint32_t entry : _sparse) {
+        _dense[entry >> 8] = static_cast<uint8_t>(entry & 0xff);
+    }
+
+    _sparse = std::vector<uint32_t> {};
+}
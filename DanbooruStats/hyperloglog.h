@@ -0,0 +1,44 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Mergeable sketch of the number of distinct values added to it. Small sketches store their
+ * non-zero registers sparsely, they switch to one byte per register once that's smaller.
+ */
+class hyperloglog {
+    public:
+    static constexpr int precision = 11;
+    static constexpr size_t registers = size_t { 1 } << precision;
+
+    private:
+    /* (register << 8) | value, sorted by register */
+    std::vector<uint32_t> _sparse;
+    std::vector<uint8_t> _dense;
+
+    public:
+    /* Relative standard error of estimate() */
+    [[nodiscard]] static double relative_error();
+
+    /* Hash of a value to add, any well mixed 64-bit hash works */
+    [[nodiscard]] static uint64_t hash(uint64_t value);
+
+    void add(uint64_t hash);
+
+    /* Afterwards this estimates the distinct values added to either */
+    void merge(const hyperloglog& other);
+
+    [[nodiscard]] double estimate() const;
+    [[nodiscard]] bool empty() const;
+
+    /* Heap memory owned by the sketch */
+    [[nodiscard]] size_t memory_usage() const;
+
+    private:
+    void _set(uint32_t index, uint8_t value);
+    void _to_dense();
+};
+
+#endif /* HYPERLOGLOG_H */
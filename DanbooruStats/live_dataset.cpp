@@ -0,0 +1,134 @@
+#include "live_dataset.h"
+
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <set>
+
+using std::chrono::steady_clock;
+
+live_dataset::live_dataset(std::map<int, std::string> paths, const database_options& options)
+    : _paths { std::move(paths) }, _options { options }
+    , _current { std::make_shared<database_set>(_paths, _options) } {
+
+    /* efsw watches directories, so watch every directory with a file once */
+    std::set<std::filesystem::path> dirs;
+    for (const auto& [year, path] : _paths) {
+        auto file = std::filesystem::absolute(path).lexically_normal();
+
+        _watched_files.push_back(file);
+        dirs.insert(file.parent_path());
+    }
+
+    for (const auto& dir : dirs) {
+        efsw::WatchID id = _watcher.addWatch(dir.string(), this, false);
+        if (id < 0) {
+            throw std::runtime_error { std::format("Failed to watch {}, error {}", dir.string(), id) };
+        }
+
+        spdlog::info("Watching {} for changed databases", dir.string());
+        _watch_ids.push_back(id);
+    }
+
+    _watcher.watch();
+
+    _reloader = std::jthread { [this](std::stop_token stop) { _reload_loop(stop); } };
+}
+
+live_dataset::~live_dataset() {
+    /* The reloader is stopped after this, by it's jthread */
+    for (efsw::WatchID id : _watch_ids) {
+        _watcher.removeWatch(id);
+    }
+}
+
+std::shared_ptr<database_set> live_dataset::current() const {
+    return _current.load();
+}
+
+void live_dataset::reload() {
+    {
+        std::scoped_lock lock { _reload_lock };
+        _reload_pending = true;
+        _reload_at = steady_clock::now() + settle_time;
+    }
+
+    _reload_cv.notify_all();
+}
+
+void live_dataset::_reload_loop(std::stop_token stop) {
+    /* Replaced instances, freeing one takes long enough that it shouldn't happen on a request's thread.
+     * New references are only taken from _current, so once it's replaced a count of 1 stays 1.
+     * That holds as long as nobody locks a weak_ptr to an instance, the ingest thread only compares them.
+     */
+    std::vector<std::shared_ptr<database_set>> replaced;
+
+    while (!stop.stop_requested()) {
+        std::erase_if(replaced, [](const std::shared_ptr<database_set>& set) { return set.use_count() == 1; });
+
+        {
+            std::unique_lock lock { _reload_lock };
+            if (replaced.empty()) {
+                if (!_reload_cv.wait(lock, stop, [this] { return _reload_pending; })) {
+                    return;
+                }
+            } else if (!_reload_cv.wait_for(lock, stop, release_interval, [this] { return _reload_pending; })) {
+                continue;
+            }
+
+            /* Every change pushes this back, so we only load once the files are quiet */
+            while (!stop.stop_requested() && steady_clock::now() < _reload_at) {
+                (void) _reload_cv.wait_until(lock, stop, _reload_at, [] { return false; });
+            }
+
+            if (stop.stop_requested()) {
+                return;
+            }
+
+            _reload_pending = false;
+        }
+
+        spdlog::info("Databases changed, loading them again");
+
+        auto begin = steady_clock::now();
+
+        /* Shutting down doesn't wait for a load that may take minutes */
+        database_options options = _options;
+        options.stop = stop;
+
+        std::shared_ptr<database_set> loaded;
+        try {
+            loaded = std::make_shared<database_set>(_paths, options);
+        } catch (const load_stopped&) {
+            spdlog::info("Stopped loading the changed databases");
+            return;
+        } catch (const std::exception& e) {
+            /* Probably still being written, the next change tries again */
+            spdlog::error("Failed to load changed databases, keeping the current ones: {}", e.what());
+            continue;
+        }
+
+        auto end = steady_clock::now();
+
+        /* Requests still holding the old instance finish against it */
+        replaced.push_back(_current.exchange(std::move(loaded)));
+
+        spdlog::info("Switched to the changed databases, loaded in {}", end - begin);
+    }
+}
+
+void live_dataset::handleFileAction(efsw::WatchID watch_id, const std::string& dir,
+    const std::string& filename, efsw::Action action, std::string old_filename) {
+    /* Deleting a file doesn't give us anything to load */
+    if (action == efsw::Actions::Delete) {
+        return;
+    }
+
+    auto path = (std::filesystem::path(dir) / filename).lexically_normal();
+    if (std::ranges::find(_watched_files, path) != _watched_files.end()) {
+        spdlog::info("{} changed", path.string());
+        reload();
+    }
+}
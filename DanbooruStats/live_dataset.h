@@ -0,0 +1,76 @@
+#ifndef LIVE_DATASET_H
+#define LIVE_DATASET_H
+
+#include "database_set.h"
+
+#include <efsw/efsw.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* The current database_set, replaced by a freshly loaded one whenever one of it's files changes.
+ * Loading happens in the background while the old instance keeps serving. Requests hold the
+ * instance they started with, the old one is freed by the reloader once the last of them is done.
+ *
+ * Files should be replaced (written elsewhere and renamed) rather than overwritten,
+ * snapshots are mapped by the instance that's still serving.
+ */
+class live_dataset : private efsw::FileWatchListener {
+    public:
+    /* Wait this long after the last change before reloading, so copies can finish */
+    static constexpr std::chrono::seconds settle_time { 10 };
+
+    /* How often replaced instances are checked for whether the last request is done with them */
+    static constexpr std::chrono::seconds release_interval { 1 };
+
+    private:
+    std::map<int, std::string> _paths;
+    database_options _options;
+
+    /* Absolute paths of all files, to match watcher events against */
+    std::vector<std::filesystem::path> _watched_files;
+
+    std::atomic<std::shared_ptr<database_set>> _current;
+
+    efsw::FileWatcher _watcher;
+    std::vector<efsw::WatchID> _watch_ids;
+
+    std::mutex _reload_lock;
+    std::condition_variable_any _reload_cv;
+    bool _reload_pending = false;
+    std::chrono::steady_clock::time_point _reload_at;
+
+    /* Last, so it's stopped before anything it uses is destroyed */
+    std::jthread _reloader;
+
+    public:
+    /* Loads the databases right away, see database_set */
+    explicit live_dataset(std::map<int, std::string> paths, const database_options& options = {});
+    ~live_dataset() override;
+
+    live_dataset(const live_dataset&) = delete;
+    live_dataset& operator=(const live_dataset&) = delete;
+
+    /* Instance to use for a whole request, it stays valid as long as it's held.
+     * Don't lock weak_ptrs to instances, that could free a replaced one on the caller's thread.
+     */
+    [[nodiscard]] std::shared_ptr<database_set> current() const;
+
+    /* Load all files again after settle_time, regardless of whether they changed */
+    void reload();
+
+    private:
+    void _reload_loop(std::stop_token stop);
+
+    void handleFileAction(efsw::WatchID watch_id, const std::string& dir,
+        const std::string& filename, efsw::Action action, std::string old_filename) override;
+};
+
+#endif /* LIVE_DATASET_H */
@@ -2,13 +2,99 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
-#include "database.h"
+#include "live_dataset.h"
+#include "trending_tags.h"
 #include "web_server.h"
 #include "danbooru.h"
 #include "rate_limit.h"
 
+#include <charconv>
+#include <condition_variable>
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+
+/* DATABASES is a comma-separated list of paths, DATABASE a single one.
+ * Only the earliest year can be a snapshot, see database_set::check_paths.
+ */
+static std::map<int, std::string> parse_database_paths() {
+	std::vector<std::string> paths;
+	if (const char* list = std::getenv("DATABASES")) {
+		std::string_view rest = list;
+		while (!rest.empty()) {
+			size_t end = rest.find(',');
+			std::string_view path = rest.substr(0, end);
+			if (!path.empty()) {
+				paths.emplace_back(path);
+			}
+
+			rest = (end == std::string_view::npos) ? std::string_view {} : rest.substr(end + 1);
+		}
+	} else {
+		const char* path = std::getenv("DATABASE");
+		paths.emplace_back(path ? path : "data/2023.db");
+	}
+
+	std::map<int, std::string> res;
+	for (std::string& path : paths) {
+		std::string stem = std::filesystem::path { path }.stem().string();
+
+		int year;
+		auto [ptr, ec] = std::from_chars(stem.data(), stem.data() + stem.size(), year);
+		if (ec != std::errc {} || ptr != stem.data() + stem.size()) {
+			throw std::runtime_error { std::format("{} is not named after a year", path) };
+		}
+
+		if (!res.emplace(year, std::move(path)).second) {
+			throw std::runtime_error { std::format("{} is given more than once", year) };
+		}
+	}
+
+	return res;
+}
+
+/* Read a number from an environment variable into value, which is left alone if it's unset.
+ * Logs and returns false if it's set to anything but a number in [min, max].
+ */
+template <typename T>
+static bool parse_env(const char* name, T& value, T min = std::numeric_limits<T>::min(), T max = std::numeric_limits<T>::max()) {
+	const char* string = std::getenv(name);
+	if (!string) {
+		return true;
+	}
+
+	std::string_view view = string;
+
+	T res;
+	auto [ptr, ec] = std::from_chars(view.data(), view.data() + view.size(), res);
+	if (ec != std::errc {} || ptr != view.data() + view.size() || res < min || res > max) {
+		spdlog::error("Invalid {} \"{}\", expected a number from {} to {}", name, view, min, max);
+		return false;
+	}
+
+	value = res;
+	return true;
+}
+
+/* A size in MiB from an environment variable, see parse_env */
+static bool parse_megabytes_env(const char* name, size_t& bytes) {
+	if (!std::getenv(name)) {
+		return true;
+	}
+
+	/* At most what still fits once shifted */
+	size_t megabytes = 0;
+	if (!parse_env(name, megabytes, size_t { 0 }, std::numeric_limits<size_t>::max() >> 20)) {
+		return false;
+	}
+
+	bytes = megabytes << 20;
+	return true;
+}
 
 static void load_dotenv() {
 	std::ifstream dotenv{ ".env" };
@@ -28,7 +114,7 @@ static void flush_spdlog() {
 	spdlog::default_logger()->flush();
 }
 
-int main() {
+int main(int argc, char** argv) {
 	/* Output to stdout and a to a file */
 	std::vector<spdlog::sink_ptr> sinks{
 		std::make_shared<spdlog::sinks::stdout_color_sink_mt>(),
@@ -49,11 +135,129 @@ int main() {
 
 	load_dotenv();
 
+	/* Unset uses all hardware threads */
+	database_options options;
+	if (!parse_env("LOADER_THREADS", options.loader_threads, size_t { 1 }) || !parse_env("WORKER_THREADS", options.worker_threads, size_t { 1 })) {
+		return EXIT_FAILURE;
+	}
+
+	if (!parse_megabytes_env("CACHE_BUDGET_MB", options.cache_budget) || !parse_megabytes_env("COOCCURRENCE_BUDGET_MB", options.cooccurrence_budget)) {
+		return EXIT_FAILURE;
+	}
+
+	/* Rendered pages, checked against the dataset version and templates */
+	size_t page_cache_budget = web_server::default_page_cache_budget;
+	if (!parse_megabytes_env("PAGE_CACHE_MB", page_cache_budget)) {
+		return EXIT_FAILURE;
+	}
+
+	if (const char* prepopulate = std::getenv("PREPOPULATE_CACHE")) {
+		options.prepopulate_cache = std::string_view { prepopulate } == "1";
+	}
+
+	if (const char* catalog = std::getenv("TAG_CATALOG")) {
+		options.tag_catalog = catalog;
+	}
+
+	/* Offline step: calculate everything once and store it, to be passed as DATABASE later */
+	if (argc == 4 && argv[1] == std::string_view { "--write-snapshot" }) {
+		try {
+			/* Snapshots don't store related tags or user percentiles */
+			options.cooccurrence_budget = 0;
+			options.user_percentiles = false;
+			database { argv[2], options }.write_snapshot(argv[3]);
+		} catch (const std::exception& e) {
+			spdlog::error("Failed to write snapshot: {}", e.what());
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	} else if (argc != 1) {
+		spdlog::error("Usage:\n    {}\n    {} --write-snapshot <database> <snapshot>", argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
 	danbooru danbooru { std::getenv("DANBOORU_LOGIN"), std::getenv("DANBOORU_API_KEY") };
 
-	database db { "data/2023.db" };
+	/* Either SQLite databases or snapshots, one per year, named after their year (data/2023.db) */
+	std::map<int, std::string> database_paths;
+	try {
+		database_paths = parse_database_paths();
+		database_set::check_paths(database_paths);
+	} catch (const std::exception& e) {
+		spdlog::error("Invalid DATABASES: {}", e.what());
+		return EXIT_FAILURE;
+	}
+
+	/* Loaded again in the background whenever a file is replaced */
+	live_dataset data { database_paths, options };
+
+	/* Tags added most often recently, from the same versions */
+	trending_tags trending;
+
+	/* Keep the counts up to date with versions collected by ensure_coherent_post_versions */
+	std::jthread ingest;
+	if (const char* versions_path = std::getenv("POST_VERSIONS")) {
+		/* A version ID, and seconds between polls of the feed */
+		int64_t after = 0;
+		int64_t interval_seconds = 60;
+		if (!parse_env("POST_VERSIONS_AFTER", after, int64_t { 0 }) || !parse_env("POST_VERSIONS_INTERVAL", interval_seconds, int64_t { 1 })) {
+			return EXIT_FAILURE;
+		}
+
+		std::chrono::seconds interval { interval_seconds };
+
+		ingest = std::jthread { [&data, &trending, versions_path = std::string { versions_path }, after, interval](std::stop_token stop) {
+			std::mutex mutex;
+			std::condition_variable_any cv;
+
+			version_feed feed { versions_path, after };
+
+			/* Not owning, so a replaced instance is still freed. Only ever compared, never locked,
+			 * so the last reference to a replaced instance isn't dropped here, see live_dataset.
+			 */
+			std::weak_ptr<database_set> applied_to;
+
+			/* Read from the feed but not applied yet, kept until applying them succeeds.
+			 * Changes already reflected in a post are skipped, so applying some twice is harmless.
+			 */
+			std::vector<post_version> versions;
+
+			while (!stop.stop_requested()) {
+				try {
+					auto db = data.current();
+
+					/* Versions already in a reloaded file are skipped when applying them again */
+					if (applied_to.owner_before(db) || db.owner_before(applied_to)) {
+						feed = version_feed { versions_path, after };
+						applied_to = db;
+						versions.clear();
+					}
+
+					if (versions.empty()) {
+						versions = feed.next(65536);
+					}
+
+					if (!versions.empty()) {
+						db->apply(versions);
+
+						/* Replayed versions are skipped */
+						trending.add(versions);
+						versions.clear();
+						continue;
+					}
+				} catch (const std::exception& e) {
+					spdlog::error("Failed to apply {} post versions up to #{}, trying again: {}", versions.size(), feed.last_id(), e.what());
+				}
+
+				/* Wait for new versions, or until we're stopped */
+				std::unique_lock lock { mutex };
+				cv.wait_for(lock, stop, interval, [] { return false; });
+			}
+		} };
+	}
 
-	web_server server { danbooru, db };
+	web_server server { danbooru, data, trending, page_cache_budget };
 
 	try {
 		server.listen("0.0.0.0", 26980);
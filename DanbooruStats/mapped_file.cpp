@@ -0,0 +1,88 @@
+#include "mapped_file.h"
+
+#include <format>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+mapped_file::mapped_file(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error { std::format("Failed to open {}, error {}", path, GetLastError()) };
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error { std::format("Failed to get size of {}, error {}", path, GetLastError()) };
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw std::runtime_error { std::format("Failed to map {}, error {}", path, GetLastError()) };
+    }
+
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error { std::format("Failed to map view of {}, error {}", path, GetLastError()) };
+    }
+
+    _data = static_cast<const std::byte*>(data);
+    _size = static_cast<size_t>(size.QuadPart);
+    _file = file;
+    _mapping = mapping;
+}
+
+mapped_file::~mapped_file() {
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+}
+#else
+mapped_file::mapped_file(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error { std::format("Failed to open {}, error {}", path, errno) };
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error { std::format("Failed to get size of {}, error {}", path, errno) };
+    }
+
+    _size = static_cast<size_t>(st.st_size);
+
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+    /* The mapping stays valid after closing */
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        throw std::runtime_error { std::format("Failed to map {}, error {}", path, errno) };
+    }
+
+    _data = static_cast<const std::byte*>(data);
+}
+
+mapped_file::~mapped_file() {
+    munmap(const_cast<std::byte*>(_data), _size);
+}
+#endif
+
+std::span<const std::byte> mapped_file::data() const {
+    return { _data, _size };
+}
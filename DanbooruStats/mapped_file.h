@@ -0,0 +1,30 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+/* Read-only shared memory mapping of an entire file. Mapping the same file
+ * from several processes shares the pages through the page cache.
+ */
+class mapped_file {
+    const std::byte* _data = nullptr;
+    size_t _size = 0;
+
+#ifdef _WIN32
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#endif
+
+    public:
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    [[nodiscard]] std::span<const std::byte> data() const;
+};
+
+#endif /* MAPPED_FILE_H */
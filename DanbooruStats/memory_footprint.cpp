@@ -0,0 +1,36 @@
+#include "memory_footprint.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+
+#include <fstream>
+#endif
+
+#ifdef _WIN32
+size_t resident_memory() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.WorkingSetSize;
+}
+#else
+size_t resident_memory() {
+    /* Second field is the resident set in pages */
+    std::ifstream statm { "/proc/self/statm" };
+
+    size_t total_pages;
+    size_t resident_pages;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef MEMORY_FOOTPRINT_H
+#define MEMORY_FOOTPRINT_H
+
+#include <cstddef>
+#include <string>
+
+/* Memory used by a structure, as counted by the structure itself */
+struct memory_footprint {
+    /* Heap memory owned by the structure */
+    size_t owned = 0;
+
+    /* Memory referred to in a mapped snapshot */
+    size_t mapped = 0;
+
+    memory_footprint& operator+=(const memory_footprint& other) {
+        owned += other.owned;
+        mapped += other.mapped;
+        return *this;
+    }
+};
+
+/* A line in a memory report */
+struct memory_entry {
+    std::string name;
+    memory_footprint footprint;
+};
+
+/* Estimate for node-based containers: every entry is a separate allocation with two pointers of overhead */
+template <typename Container>
+[[nodiscard]] size_t node_container_bytes(const Container& container) {
+    size_t res = container.size() * (sizeof(typename Container::value_type) + 2 * sizeof(void*));
+    if constexpr (requires { container.bucket_count(); }) {
+        res += container.bucket_count() * sizeof(void*);
+    }
+
+    return res;
+}
+
+/* Heap memory of a db_map_type or any other map, not counting what the entries own */
+template <typename Map>
+[[nodiscard]] size_t map_bytes(const Map& map) {
+    if constexpr (requires { map.memory_usage(); }) {
+        return map.memory_usage();
+    } else {
+        return node_container_bytes(map);
+    }
+}
+
+/* Resident memory of the whole process as reported by the OS, 0 if unknown */
+[[nodiscard]] size_t resident_memory();
+
+#endif /* MEMORY_FOOTPRINT_H */
@@ -0,0 +1,184 @@
+#include "post_aggregation.h"
+
+#include "flat_hash_map.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+/* Rows processed together, small enough for every column of a batch to stay in L1 */
+static constexpr size_t batch_size = 1024;
+
+/* Rows per parallel task */
+static constexpr size_t slice_size = size_t { 1 } << 20;
+
+struct key_hash {
+    [[nodiscard]] size_t operator()(const std::array<int64_t, 2>& key) const {
+        return std::hash<uint64_t> {}((static_cast<uint64_t>(key[0]) * 0x9E3779B97F4A7C15ull) + static_cast<uint64_t>(key[1]));
+    }
+};
+
+/* Copy rows [first, first + count) of a column to out, widened */
+static void gather(const post_table& posts, post_column column, size_t first, size_t count, int64_t* out) {
+    auto widen = [&](auto values) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<int64_t>(values[first + i]);
+        }
+    };
+
+    switch (column) {
+        using enum post_column;
+        case uploader_id:  widen(posts.uploader_ids()); break;
+        case approver_id:  widen(posts.approver_ids()); break;
+        case rating:       widen(posts.ratings()); break;
+        case file_ext:     widen(posts.file_exts()); break;
+        case score:        widen(posts.scores()); break;
+        case fav_count:    widen(posts.fav_counts()); break;
+        case file_size:    widen(posts.file_sizes()); break;
+        case image_width:  widen(posts.image_widths()); break;
+        case image_height: widen(posts.image_heights()); break;
+    }
+}
+
+/* Round down to a multiple of bucket, also for negative values */
+static void bucket_values(int64_t* values, size_t count, int64_t bucket) {
+    if (bucket == 1) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        int64_t quotient = values[i] / bucket;
+        if ((values[i] % bucket != 0) && (values[i] < 0)) {
+            quotient -= 1;
+        }
+
+        values[i] = quotient * bucket;
+    }
+}
+
+static std::vector<aggregate_row> aggregate_slice(const post_table& posts, const aggregate_query& query, size_t first_row, size_t last_row) {
+    std::vector<aggregate_row> res;
+
+    /* Every distinct value of a column gets a dense ID, a pair of those identifies a group */
+    std::array<flat_hash_map<int64_t, uint32_t>, 2> value_ids;
+    flat_hash_map<uint64_t, uint32_t> groups;
+
+    /* Unused parts stay 0 */
+    std::array<std::array<int64_t, batch_size>, 2> keys {};
+    std::array<std::array<uint32_t, batch_size>, 2> key_ids {};
+
+    std::array<uint32_t, batch_size> group_ids;
+    std::array<int64_t, batch_size> measures;
+
+    for (size_t first = first_row; first < last_row; first += batch_size) {
+        size_t count = std::min(batch_size, last_row - first);
+
+        for (size_t part = 0; part < query.groups.size(); ++part) {
+            const group_by& group = query.groups[part];
+
+            gather(posts, group.column, first, count, keys[part].data());
+            bucket_values(keys[part].data(), count, group.bucket);
+
+            for (size_t i = 0; i < count; ++i) {
+                key_ids[part][i] = value_ids[part].try_emplace(keys[part][i], static_cast<uint32_t>(value_ids[part].size())).first->second;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            /* With a single column, value IDs are assigned in the same order as groups */
+            uint32_t group = key_ids[0][i];
+            if (query.groups.size() > 1) {
+                uint64_t pair = (uint64_t { key_ids[0][i] } << 32) | key_ids[1][i];
+                group = groups.try_emplace(pair, static_cast<uint32_t>(res.size())).first->second;
+            }
+
+            if (group == res.size()) {
+                res.push_back(aggregate_row {
+                    .key = { keys[0][i], keys[1][i] },
+                    .count = 0,
+                    .sum = 0,
+                    .min = std::numeric_limits<int64_t>::max(),
+                    .max = std::numeric_limits<int64_t>::min(),
+                });
+            }
+
+            group_ids[i] = group;
+        }
+
+        if (!query.measure) {
+            for (size_t i = 0; i < count; ++i) {
+                res[group_ids[i]].count += 1;
+            }
+
+            continue;
+        }
+
+        gather(posts, *query.measure, first, count, measures.data());
+        for (size_t i = 0; i < count; ++i) {
+            aggregate_row& row = res[group_ids[i]];
+            row.count += 1;
+            row.sum += measures[i];
+            row.min = std::min(row.min, measures[i]);
+            row.max = std::max(row.max, measures[i]);
+        }
+    }
+
+    /* Nothing was measured */
+    if (!query.measure) {
+        for (aggregate_row& row : res) {
+            row.min = 0;
+            row.max = 0;
+        }
+    }
+
+    return res;
+}
+
+std::vector<aggregate_row> aggregate(const post_table& posts, const aggregate_query& query, thread_pool& pool) {
+    if (query.groups.empty() || query.groups.size() > 2) {
+        throw std::invalid_argument { "Aggregates are grouped by one or two columns" };
+    }
+
+    for (const group_by& group : query.groups) {
+        if (group.bucket <= 0) {
+            throw std::invalid_argument { "Buckets must be positive" };
+        }
+    }
+
+    size_t slices = (posts.size() + slice_size - 1) / slice_size;
+    std::vector<std::vector<aggregate_row>> partial(slices);
+
+    pool.parallel_for(slices, [&](size_t slice) {
+        partial[slice] = aggregate_slice(posts, query, slice * slice_size, std::min(posts.size(), (slice + 1) * slice_size));
+    });
+
+    if (partial.size() == 1) {
+        return std::move(partial.front());
+    }
+
+    return merge_aggregates(partial);
+}
+
+std::vector<aggregate_row> merge_aggregates(std::span<const std::vector<aggregate_row>> results) {
+    std::vector<aggregate_row> res;
+    flat_hash_map<std::array<int64_t, 2>, uint32_t, key_hash> rows;
+
+    for (const auto& result : results) {
+        for (const aggregate_row& row : result) {
+            auto [it, inserted] = rows.try_emplace(row.key, static_cast<uint32_t>(res.size()));
+            if (inserted) {
+                res.push_back(row);
+                continue;
+            }
+
+            aggregate_row& merged = res[it->second];
+            merged.count += row.count;
+            merged.sum += row.sum;
+            merged.min = std::min(merged.min, row.min);
+            merged.max = std::max(merged.max, row.max);
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,62 @@
+#ifndef POST_AGGREGATION_H
+#define POST_AGGREGATION_H
+
+#include "post_table.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+class thread_pool;
+
+/* Numeric columns of a post_table, all of them can be grouped by or aggregated */
+enum class post_column {
+    uploader_id,
+    approver_id,
+    rating,
+    file_ext,
+    score,
+    fav_count,
+    file_size,
+    image_width,
+    image_height,
+};
+
+struct group_by {
+    post_column column;
+
+    /* Values are grouped by the multiple of bucket at or below them, 1 groups by value */
+    int64_t bucket = 1;
+};
+
+struct aggregate_query {
+    /* One or two columns */
+    std::vector<group_by> groups;
+
+    /* Summed, and the minimum and maximum taken, of every group. Without one, groups are only counted. */
+    std::optional<post_column> measure;
+};
+
+/* A single group, unused key parts are 0 */
+struct aggregate_row {
+    std::array<int64_t, 2> key;
+
+    int64_t count;
+
+    /* Of the measure, all 0 without one */
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+};
+
+/* Group every row of posts, in no particular order. Rows are processed a batch at a time, a column
+ * at a time, in plain scalar loops that each only touch a few small arrays.
+ */
+[[nodiscard]] std::vector<aggregate_row> aggregate(const post_table& posts, const aggregate_query& query, thread_pool& pool);
+
+/* Combine results of the same query on other rows */
+[[nodiscard]] std::vector<aggregate_row> merge_aggregates(std::span<const std::vector<aggregate_row>> results);
+
+#endif /* POST_AGGREGATION_H */
@@ -0,0 +1,301 @@
+#include "post_loader.h"
+
+#include "tag_tokenizer.h"
+#include "util.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <spdlog/spdlog.h>
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <future>
+#include <limits>
+#include <memory>
+#include <thread>
+
+using std::chrono::steady_clock;
+
+/* Columns before the tag strings, see post_attributes */
+static constexpr int attribute_columns = 10;
+
+/* Rough tags per post of every category on Danbooru, only used to reserve room up front */
+static constexpr size_t expected_tags(tag_type type) {
+    switch (type) {
+        case tag_type::general:   return 25;
+        case tag_type::artist:    return 1;
+        case tag_type::copyright: return 2;
+        case tag_type::character: return 2;
+        case tag_type::meta:      return 3;
+    }
+
+    return 0;
+}
+
+/* Only the columns we use, tag strings in tag_type order after the attributes */
+static std::string projected_query() {
+    std::string res = "select id, uploader_id, approver_id, rating, file_ext, score, fav_count, file_size, image_width, image_height";
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        res += std::format(", tag_string_{}", magic_enum::enum_name(type));
+    }
+
+    res += " from posts where rowid between ? and ?";
+
+    return res;
+}
+
+using statement_ptr = std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)>;
+
+/* Integer column clamped to T, so values out of range saturate instead of wrapping */
+template <typename T>
+static T column_clamped(sqlite3_stmt* stmt, int column) {
+    int64_t value = sqlite3_column_int64(stmt, column);
+    return static_cast<T>(std::clamp<int64_t>(value, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+}
+
+/* Text of a column, pointing into SQLite's row buffer until the next step */
+static std::string_view column_text(sqlite3_stmt* stmt, int column) {
+    const auto* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+    return { text ? text : "", static_cast<size_t>(sqlite3_column_bytes(stmt, column)) };
+}
+
+post_loader::post_loader(std::string path, size_t threads, std::stop_token stop)
+    : _path { std::move(path) }
+    , _threads { threads == 0 ? std::max<size_t>(std::thread::hardware_concurrency(), 1) : threads }
+    , _stop { std::move(stop) } {
+
+}
+
+void post_loader::load(tag_dictionary& tags, post_table& posts, user_post_map& user_posts) {
+    auto begin = steady_clock::now();
+
+    SQLite::Database db { _path, SQLite::OPEN_READONLY };
+    SQLite::Statement bounds { db, "select min(rowid), max(rowid), count(*) from posts" };
+    bounds.executeStep();
+
+    int64_t min_rowid = bounds.getColumn(0).getInt64();
+    int64_t max_rowid = bounds.getColumn(1).getInt64();
+    size_t post_count = static_cast<size_t>(bounds.getColumn(2).getInt64());
+
+    if (post_count == 0) {
+        spdlog::warn("No posts in {}", _path);
+        return;
+    }
+
+    size_t threads = std::min(_threads, post_count);
+    int64_t range_size = (max_rowid - min_rowid + static_cast<int64_t>(threads)) / static_cast<int64_t>(threads);
+
+    auto end = steady_clock::now();
+    spdlog::info("Split {} posts into {} rowid ranges in {}", post_count, threads, end - begin);
+
+    begin = steady_clock::now();
+
+    std::vector<chunk> chunks(threads);
+    std::vector<std::future<void>> futures;
+    futures.reserve(threads);
+
+    for (size_t i = 0; i < threads; ++i) {
+        int64_t first = min_rowid + static_cast<int64_t>(i) * range_size;
+        int64_t last = std::min(first + range_size - 1, max_rowid);
+
+        futures.push_back(std::async(std::launch::async, &post_loader::_load_range, this, first, last, std::ref(chunks[i])));
+    }
+
+    /* Rethrows anything thrown while loading */
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    end = steady_clock::now();
+    spdlog::info("Read {} posts on {} connections in {}", post_count, threads, end - begin);
+
+    begin = steady_clock::now();
+
+    /* Intern chunks in rowid order so IDs don't depend on thread timing */
+    for (chunk& chunk : chunks) {
+        chunk.tag_map.resize(chunk.tags.size());
+        for (tag_id id = 0; id < chunk.tag_map.size(); ++id) {
+            chunk.tag_map[id] = tags.intern(chunk.tags.name(id));
+        }
+    }
+
+    end = steady_clock::now();
+    spdlog::info("Merged {} unique tags in {}", tags.size(), end - begin);
+
+    begin = steady_clock::now();
+
+    size_t total_rows = 0;
+    tag_type_array<size_t> total_values {};
+    for (const chunk& chunk : chunks) {
+        total_rows += chunk.posts.size();
+
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            total_values[type] += chunk.posts.tags(type).values().size();
+        }
+    }
+
+    posts.resize(total_rows, total_values);
+
+    /* Every chunk fills it's own slice of the table */
+    futures.clear();
+
+    post_row first_row = 0;
+    tag_type_array<size_t> first_values {};
+    for (const chunk& chunk : chunks) {
+        futures.push_back(std::async(std::launch::async, [&posts, &chunk, first_row, first_values] {
+            posts.assign(first_row, first_values, chunk.posts, chunk.tag_map);
+        }));
+
+        first_row += static_cast<post_row>(chunk.posts.size());
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            first_values[type] += chunk.posts.tags(type).values().size();
+        }
+    }
+
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    end = steady_clock::now();
+    spdlog::info("Filled {} posts in {}", posts.size(), end - begin);
+
+    if (const tag_catalog* catalog = tags.catalog()) {
+        _check_categories(*catalog, tags, posts);
+    }
+
+    begin = steady_clock::now();
+
+    first_row = 0;
+    for (chunk& chunk : chunks) {
+        for (const auto& [uploader_id, rows] : chunk.user_posts) {
+            std::vector<post_row>& merged = user_posts[uploader_id];
+
+            for (post_row row : rows) {
+                merged.push_back(first_row + row);
+            }
+        }
+
+        first_row += static_cast<post_row>(chunk.posts.size());
+
+        /* Release chunk memory as soon as possible */
+        chunk = {};
+    }
+
+    end = steady_clock::now();
+    spdlog::info("Grouped posts for {} users in {}", user_posts.size(), end - begin);
+}
+
+void post_loader::_check_categories(const tag_catalog& catalog, const tag_dictionary& tags, const post_table& posts) const {
+    auto begin = steady_clock::now();
+
+    /* The catalog is authoritative, tags in another category were changed after one of the dumps */
+    std::vector<bool> mismatched(catalog.size());
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        for (tag_id tag : posts.tags(type).values()) {
+            if (tag < catalog.size() && catalog.category(tag) != static_cast<uint8_t>(type)) {
+                mismatched[tag] = true;
+            }
+        }
+    }
+
+    size_t count = std::ranges::count(mismatched, true);
+
+    auto end = steady_clock::now();
+    spdlog::info("Checked categories against the catalog in {}", end - begin);
+
+    if (count > 0) {
+        spdlog::warn("{} tags in {} are in a different category than in the catalog", count, _path);
+    }
+
+    if (tags.size() > catalog.size()) {
+        spdlog::warn("{} tags in {} are not in the catalog", tags.size() - catalog.size(), _path);
+    }
+}
+
+void post_loader::_load_range(int64_t first_rowid, int64_t last_rowid, chunk& chunk) const {
+    auto begin = steady_clock::now();
+
+    /* At most this many rows, gaps in the rowids only make it more than needed */
+    size_t rows = static_cast<size_t>(last_rowid - first_rowid + 1);
+    tag_type_array<size_t> values {};
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        values[type] = rows * expected_tags(type);
+    }
+
+    chunk.posts.reserve(rows, values);
+
+    SQLite::Database db { _path, SQLite::OPEN_READONLY };
+
+    /* A single sequential scan: map the whole file instead of copying pages into the cache */
+    db.exec(std::format("pragma mmap_size = {}", std::filesystem::file_size(_path)));
+    db.exec("pragma cache_size = -16384");
+    db.exec("pragma temp_store = memory");
+
+    /* Stepped with the C API, so column text is read in place instead of through SQLite::Column */
+    sqlite3_stmt* raw_stmt = nullptr;
+    std::string query = projected_query();
+    if (int res = sqlite3_prepare_v2(db.getHandle(), query.c_str(), -1, &raw_stmt, nullptr); res != SQLITE_OK) {
+        throw SQLite::Exception { db.getHandle(), res };
+    }
+
+    statement_ptr posts { raw_stmt, &sqlite3_finalize };
+    sqlite3_bind_int64(posts.get(), 1, first_rowid);
+    sqlite3_bind_int64(posts.get(), 2, last_rowid);
+
+    /* Reused between rows to avoid reallocating */
+    tag_type_array<std::vector<tag_id>> row_tags;
+    tag_tokenizer tokenizer;
+
+    int step;
+    while ((step = sqlite3_step(posts.get())) == SQLITE_ROW) {
+        int32_t id = sqlite3_column_int(posts.get(), 0);
+        int32_t uploader_id = sqlite3_column_int(posts.get(), 1);
+
+        /* NULL reads as 0 */
+        std::string_view rating = column_text(posts.get(), 3);
+        post_attributes attributes {
+            .approver_id = sqlite3_column_int(posts.get(), 2),
+            .rating = rating.empty() ? '\0' : rating.front(),
+            .file_ext = pack_file_ext(column_text(posts.get(), 4)),
+            .score = sqlite3_column_int(posts.get(), 5),
+            .fav_count = sqlite3_column_int(posts.get(), 6),
+            .file_size = column_clamped<uint32_t>(posts.get(), 7),
+            .image_width = column_clamped<uint32_t>(posts.get(), 8),
+            .image_height = column_clamped<uint32_t>(posts.get(), 9),
+        };
+
+        for (size_t i = 0; tag_type type : magic_enum::enum_values<tag_type>()) {
+            std::string_view tag_string = column_text(posts.get(), static_cast<int>(attribute_columns + i++));
+            std::vector<tag_id>& tags = row_tags[type];
+            tags.clear();
+
+            for (std::string_view tag : tokenizer.split(tag_string)) {
+                tags.push_back(chunk.tags.intern(tag));
+            }
+
+            /* Sorted and deduplicated, so counting never sees a tag twice for one post */
+            std::ranges::sort(tags);
+            tags.erase(std::ranges::unique(tags).begin(), tags.end());
+        }
+
+        post_row row = chunk.posts.push_back(id, uploader_id, attributes, row_tags);
+        if (row % 4096 == 0 && _stop.stop_requested()) {
+            throw load_stopped { "Loading was stopped" };
+        }
+
+        auto it = chunk.user_posts.find(uploader_id);
+        if (it == chunk.user_posts.end()) {
+            chunk.user_posts.emplace(uploader_id, std::vector { row });
+        } else {
+            it->second.push_back(row);
+        }
+    }
+
+    if (step != SQLITE_DONE) {
+        throw SQLite::Exception { db.getHandle(), step };
+    }
+
+    auto end = steady_clock::now();
+    spdlog::debug("Read rowids {} to {} ({} posts) in {}", first_rowid, last_rowid, chunk.posts.size(), end - begin);
+}
@@ -0,0 +1,43 @@
+#ifndef POST_LOADER_H
+#define POST_LOADER_H
+
+#include "database.h"
+
+#include <stop_token>
+#include <string>
+
+/* Posts per uploader */
+using user_post_map = db_map_type<int32_t, std::vector<post_row>>;
+
+/* Reads the posts table by splitting it into rowid ranges,
+ * every range is read on it's own read-only connection and thread.
+ */
+class post_loader {
+    std::string _path;
+    size_t _threads;
+    std::stop_token _stop;
+
+    /* Everything read from a single rowid range, using range-local tag IDs and rows */
+    struct chunk {
+        tag_dictionary tags;
+        post_table posts;
+        user_post_map user_posts;
+
+        /* Local to global tag ID */
+        std::vector<tag_id> tag_map;
+    };
+
+    public:
+    /* 0 threads uses all hardware threads, loading throws load_stopped once stop is requested */
+    explicit post_loader(std::string path, size_t threads = 0, std::stop_token stop = {});
+
+    void load(tag_dictionary& tags, post_table& posts, user_post_map& user_posts);
+
+    private:
+    void _load_range(int64_t first_rowid, int64_t last_rowid, chunk& chunk) const;
+
+    /* Warn about tags whose category differs from the catalog's */
+    void _check_categories(const tag_catalog& catalog, const tag_dictionary& tags, const post_table& posts) const;
+};
+
+#endif /* POST_LOADER_H */
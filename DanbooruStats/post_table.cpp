@@ -0,0 +1,314 @@
+#include "post_table.h"
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+void tag_column::reserve(size_t rows, size_t values) {
+    _offsets.mutate().reserve(rows + 1);
+    _values.mutate().reserve(values);
+}
+
+void tag_column::resize(size_t rows, size_t values) {
+    _offsets.mutate().resize(rows + 1);
+    _values.mutate().resize(values);
+}
+
+void tag_column::push_back(std::span<const tag_id> tags) {
+    std::vector<tag_id>& values = _values.mutate();
+    values.insert(values.end(), tags.begin(), tags.end());
+    _offsets.mutate().push_back(static_cast<uint32_t>(values.size()));
+}
+
+void tag_column::assign(post_row first_row, size_t first_value, const tag_column& source, std::span<const tag_id> tag_map) {
+    /* Both are owned after resize, so this never copies and is safe to call concurrently */
+    std::vector<uint32_t>& offsets = _offsets.mutate();
+    std::vector<tag_id>& values = _values.mutate();
+
+    for (size_t i = 0; i < source.size(); ++i) {
+        offsets[first_row + i + 1] = static_cast<uint32_t>(first_value + source._offsets[i + 1]);
+    }
+
+    std::ranges::transform(source._values, values.begin() + first_value, [tag_map](tag_id tag) {
+        return tag_map[tag];
+    });
+
+    /* Translating IDs doesn't preserve their order, so sort every row again */
+    for (size_t i = 0; i < source.size(); ++i) {
+        std::sort(values.begin() + offsets[first_row + i], values.begin() + offsets[first_row + i + 1]);
+    }
+}
+
+void tag_column::set(post_row row, std::vector<tag_id> tags) {
+    _replaced.insert_or_assign(row, std::move(tags));
+}
+
+std::span<const tag_id> tag_column::operator[](post_row row) const {
+    if (!_replaced.empty()) {
+        if (auto it = _replaced.find(row); it != _replaced.end()) {
+            return it->second;
+        }
+    }
+
+    return std::span { _values }.subspan(_offsets[row], _offsets[row + 1] - _offsets[row]);
+}
+
+std::span<const tag_id> tag_column::values() const {
+    return _values;
+}
+
+size_t tag_column::size() const {
+    return _offsets.size() - 1;
+}
+
+memory_footprint tag_column::footprint() const {
+    memory_footprint res = _offsets.footprint();
+    res += _values.footprint();
+
+    res.owned += node_container_bytes(_replaced);
+    for (const auto& [row, tags] : _replaced) {
+        res.owned += tags.capacity() * sizeof(tag_id);
+    }
+
+    return res;
+}
+
+void tag_column::write(snapshot_writer& writer) const {
+    if (_replaced.empty()) {
+        writer.write<uint32_t>(_offsets);
+        writer.write<tag_id>(_values);
+        return;
+    }
+
+    /* Store replaced rows in place */
+    std::vector<uint32_t> offsets { 0 };
+    std::vector<tag_id> values;
+    offsets.reserve(_offsets.size());
+    values.reserve(_values.size());
+
+    for (post_row row = 0; row < size(); ++row) {
+        auto tags = (*this)[row];
+        values.insert(values.end(), tags.begin(), tags.end());
+        offsets.push_back(static_cast<uint32_t>(values.size()));
+    }
+
+    writer.write<uint32_t>(offsets);
+    writer.write<tag_id>(values);
+}
+
+void tag_column::read(snapshot_reader& reader, size_t tags) {
+    _replaced.clear();
+    _offsets = cow_array { reader.read<uint32_t>() };
+    _values = cow_array { reader.read<tag_id>() };
+
+    /* Rows and every index built from them are read unchecked */
+    std::span<const uint32_t> offsets = _offsets;
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != _values.size() || !std::ranges::is_sorted(offsets)) {
+        throw std::runtime_error { "Corrupt tag column in snapshot" };
+    }
+
+    std::span<const tag_id> values = _values;
+    if (std::ranges::any_of(values, [tags](tag_id tag) { return tag >= tags; })) {
+        throw std::runtime_error { "Corrupt tag column in snapshot" };
+    }
+}
+
+uint32_t pack_file_ext(std::string_view ext) {
+    uint32_t res = 0;
+    std::memcpy(&res, ext.data(), std::min(ext.size(), sizeof(res)));
+
+    return res;
+}
+
+std::string unpack_file_ext(uint32_t ext) {
+    char chars[sizeof(ext)];
+    std::memcpy(chars, &ext, sizeof(ext));
+
+    return { chars, std::find(chars, chars + sizeof(ext), '\0') };
+}
+
+void post_table::reserve(size_t rows, const tag_type_array<size_t>& values) {
+    _ids.mutate().reserve(rows);
+    _uploader_ids.mutate().reserve(rows);
+    _approver_ids.mutate().reserve(rows);
+    _ratings.mutate().reserve(rows);
+    _file_exts.mutate().reserve(rows);
+    _scores.mutate().reserve(rows);
+    _fav_counts.mutate().reserve(rows);
+    _file_sizes.mutate().reserve(rows);
+    _image_widths.mutate().reserve(rows);
+    _image_heights.mutate().reserve(rows);
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].reserve(rows, values[type]);
+    }
+}
+
+void post_table::resize(size_t rows, const tag_type_array<size_t>& values) {
+    _ids.mutate().resize(rows);
+    _uploader_ids.mutate().resize(rows);
+    _approver_ids.mutate().resize(rows);
+    _ratings.mutate().resize(rows);
+    _file_exts.mutate().resize(rows);
+    _scores.mutate().resize(rows);
+    _fav_counts.mutate().resize(rows);
+    _file_sizes.mutate().resize(rows);
+    _image_widths.mutate().resize(rows);
+    _image_heights.mutate().resize(rows);
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].resize(rows, values[type]);
+    }
+}
+
+post_row post_table::push_back(int32_t id, int32_t uploader_id, const post_attributes& attributes, const tag_type_array<std::vector<tag_id>>& tags) {
+    post_row row = static_cast<post_row>(_ids.size());
+
+    _ids.mutate().push_back(id);
+    _uploader_ids.mutate().push_back(uploader_id);
+    _approver_ids.mutate().push_back(attributes.approver_id);
+    _ratings.mutate().push_back(attributes.rating);
+    _file_exts.mutate().push_back(attributes.file_ext);
+    _scores.mutate().push_back(attributes.score);
+    _fav_counts.mutate().push_back(attributes.fav_count);
+    _file_sizes.mutate().push_back(attributes.file_size);
+    _image_widths.mutate().push_back(attributes.image_width);
+    _image_heights.mutate().push_back(attributes.image_height);
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].push_back(tags[type]);
+    }
+
+    return row;
+}
+
+void post_table::assign(post_row first_row, const tag_type_array<size_t>& first_values, const post_table& source, std::span<const tag_id> tag_map) {
+    std::ranges::copy(source._ids, _ids.mutate().begin() + first_row);
+    std::ranges::copy(source._uploader_ids, _uploader_ids.mutate().begin() + first_row);
+    std::ranges::copy(source._approver_ids, _approver_ids.mutate().begin() + first_row);
+    std::ranges::copy(source._ratings, _ratings.mutate().begin() + first_row);
+    std::ranges::copy(source._file_exts, _file_exts.mutate().begin() + first_row);
+    std::ranges::copy(source._scores, _scores.mutate().begin() + first_row);
+    std::ranges::copy(source._fav_counts, _fav_counts.mutate().begin() + first_row);
+    std::ranges::copy(source._file_sizes, _file_sizes.mutate().begin() + first_row);
+    std::ranges::copy(source._image_widths, _image_widths.mutate().begin() + first_row);
+    std::ranges::copy(source._image_heights, _image_heights.mutate().begin() + first_row);
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].assign(first_row, first_values[type], source._tags[type], tag_map);
+    }
+}
+
+void post_table::set_tags(post_row row, tag_type type, std::vector<tag_id> tags) {
+    _tags[type].set(row, std::move(tags));
+}
+
+size_t post_table::size() const {
+    return _ids.size();
+}
+
+std::span<const int32_t> post_table::ids() const {
+    return _ids;
+}
+
+std::span<const int32_t> post_table::uploader_ids() const {
+    return _uploader_ids;
+}
+
+std::span<const int32_t> post_table::approver_ids() const {
+    return _approver_ids;
+}
+
+std::span<const char> post_table::ratings() const {
+    return _ratings;
+}
+
+std::span<const uint32_t> post_table::file_exts() const {
+    return _file_exts;
+}
+
+std::span<const int32_t> post_table::scores() const {
+    return _scores;
+}
+
+std::span<const int32_t> post_table::fav_counts() const {
+    return _fav_counts;
+}
+
+std::span<const uint32_t> post_table::file_sizes() const {
+    return _file_sizes;
+}
+
+std::span<const uint32_t> post_table::image_widths() const {
+    return _image_widths;
+}
+
+std::span<const uint32_t> post_table::image_heights() const {
+    return _image_heights;
+}
+
+const tag_column& post_table::tags(tag_type type) const {
+    return _tags[type];
+}
+
+memory_footprint post_table::footprint() const {
+    memory_footprint res = _ids.footprint();
+    res += _uploader_ids.footprint();
+    res += _approver_ids.footprint();
+    res += _ratings.footprint();
+    res += _file_exts.footprint();
+    res += _scores.footprint();
+    res += _fav_counts.footprint();
+    res += _file_sizes.footprint();
+    res += _image_widths.footprint();
+    res += _image_heights.footprint();
+
+    return res;
+}
+
+void post_table::write(snapshot_writer& writer) const {
+    writer.write<int32_t>(_ids);
+    writer.write<int32_t>(_uploader_ids);
+    writer.write<int32_t>(_approver_ids);
+    writer.write<char>(_ratings);
+    writer.write<uint32_t>(_file_exts);
+    writer.write<int32_t>(_scores);
+    writer.write<int32_t>(_fav_counts);
+    writer.write<uint32_t>(_file_sizes);
+    writer.write<uint32_t>(_image_widths);
+    writer.write<uint32_t>(_image_heights);
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].write(writer);
+    }
+}
+
+void post_table::read(snapshot_reader& reader, size_t tags) {
+    _ids = cow_array { reader.read<int32_t>() };
+    _uploader_ids = cow_array { reader.read<int32_t>() };
+    _approver_ids = cow_array { reader.read<int32_t>() };
+    _ratings = cow_array { reader.read<char>() };
+    _file_exts = cow_array { reader.read<uint32_t>() };
+    _scores = cow_array { reader.read<int32_t>() };
+    _fav_counts = cow_array { reader.read<int32_t>() };
+    _file_sizes = cow_array { reader.read<uint32_t>() };
+    _image_widths = cow_array { reader.read<uint32_t>() };
+    _image_heights = cow_array { reader.read<uint32_t>() };
+
+    size_t rows = _ids.size();
+    bool valid = _uploader_ids.size() == rows && _approver_ids.size() == rows && _ratings.size() == rows && _file_exts.size() == rows
+        && _scores.size() == rows && _fav_counts.size() == rows && _file_sizes.size() == rows && _image_widths.size() == rows && _image_heights.size() == rows;
+
+    if (!valid) {
+        throw std::runtime_error { "Corrupt post table in snapshot" };
+    }
+
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        _tags[type].read(reader, tags);
+
+        if (_tags[type].size() != _ids.size()) {
+            throw std::runtime_error { "Corrupt post table in snapshot" };
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef POST_TABLE_H
+#define POST_TABLE_H
+
+#include "cow_array.h"
+#include "tag_dictionary.h"
+
+#include <magic_enum.hpp>
+#include <magic_enum_containers.hpp>
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class tag_type {
+    general   = 0,
+    artist    = 1,
+    copyright = 3,
+    character = 4,
+    meta      = 5,
+};
+
+template <typename T>
+using tag_type_array = magic_enum::containers::array<tag_type, T>;
+
+class snapshot_reader;
+class snapshot_writer;
+
+/* Index of a post in a post_table */
+using post_row = uint32_t;
+
+/* Variable-length tag lists for all rows, stored as one flat array plus row offsets */
+class tag_column {
+    cow_array<uint32_t> _offsets { std::vector<uint32_t> { 0 } };
+    cow_array<tag_id> _values;
+
+    /* Rows replaced after loading, these take precedence over the flat array */
+    std::unordered_map<post_row, std::vector<tag_id>> _replaced;
+
+    public:
+    void reserve(size_t rows, size_t values);
+    void resize(size_t rows, size_t values);
+
+    /* Append a row */
+    void push_back(std::span<const tag_id> tags);
+
+    /* Overwrite the rows starting at first_row (whose values start at first_value) with
+     * the rows of source, translating every tag through tag_map. Disjoint ranges may be
+     * assigned concurrently.
+     */
+    void assign(post_row first_row, size_t first_value, const tag_column& source, std::span<const tag_id> tag_map);
+
+    /* Replace the (sorted) tags of a single row */
+    void set(post_row row, std::vector<tag_id> tags);
+
+    [[nodiscard]] std::span<const tag_id> operator[](post_row row) const;
+
+    /* All tags of all rows as loaded, back to back. Doesn't reflect rows replaced by set. */
+    [[nodiscard]] std::span<const tag_id> values() const;
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    void write(snapshot_writer& writer) const;
+
+    /* Refer to the tags in a mapped snapshot, which must all be below tags */
+    void read(snapshot_reader& reader, size_t tags);
+};
+
+/* Everything but the tags of a row of the posts table that's worth aggregating */
+struct post_attributes {
+    /* 0 if the post wasn't approved */
+    int32_t approver_id = 0;
+    char rating = 0;
+
+    /* See pack_file_ext */
+    uint32_t file_ext = 0;
+
+    int32_t score = 0;
+    int32_t fav_count = 0;
+    uint32_t file_size = 0;
+    uint32_t image_width = 0;
+    uint32_t image_height = 0;
+};
+
+/* Up to 4 characters of a file extension, first character in the lowest byte */
+[[nodiscard]] uint32_t pack_file_ext(std::string_view ext);
+[[nodiscard]] std::string unpack_file_ext(uint32_t ext);
+
+/* Columnar post storage, every column is indexed by post_row.
+ * New columns are added as another cow_array member, filled in push_back and
+ * stored in snapshots by write and read.
+ */
+class post_table {
+    cow_array<int32_t> _ids;
+    cow_array<int32_t> _uploader_ids;
+
+    cow_array<int32_t> _approver_ids;
+    cow_array<char> _ratings;
+    cow_array<uint32_t> _file_exts;
+    cow_array<int32_t> _scores;
+    cow_array<int32_t> _fav_counts;
+    cow_array<uint32_t> _file_sizes;
+    cow_array<uint32_t> _image_widths;
+    cow_array<uint32_t> _image_heights;
+
+    tag_type_array<tag_column> _tags;
+
+    public:
+    /* Room for rows, with values tags of every category */
+    void reserve(size_t rows, const tag_type_array<size_t>& values);
+    void resize(size_t rows, const tag_type_array<size_t>& values);
+
+    post_row push_back(int32_t id, int32_t uploader_id, const post_attributes& attributes, const tag_type_array<std::vector<tag_id>>& tags);
+
+    /* Copy all rows of source to first_row, see tag_column::assign */
+    void assign(post_row first_row, const tag_type_array<size_t>& first_values, const post_table& source, std::span<const tag_id> tag_map);
+
+    /* Replace the tags of a post, see tag_column::set */
+    void set_tags(post_row row, tag_type type, std::vector<tag_id> tags);
+
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] std::span<const int32_t> ids() const;
+    [[nodiscard]] std::span<const int32_t> uploader_ids() const;
+    [[nodiscard]] std::span<const int32_t> approver_ids() const;
+    [[nodiscard]] std::span<const char> ratings() const;
+    [[nodiscard]] std::span<const uint32_t> file_exts() const;
+    [[nodiscard]] std::span<const int32_t> scores() const;
+    [[nodiscard]] std::span<const int32_t> fav_counts() const;
+    [[nodiscard]] std::span<const uint32_t> file_sizes() const;
+    [[nodiscard]] std::span<const uint32_t> image_widths() const;
+    [[nodiscard]] std::span<const uint32_t> image_heights() const;
+    [[nodiscard]] const tag_column& tags(tag_type type) const;
+
+    /* Only the ID and attribute columns, see tag_column::footprint for the rest */
+    [[nodiscard]] memory_footprint footprint() const;
+
+    void write(snapshot_writer& writer) const;
+
+    /* Refer to the columns in a mapped snapshot, with tags known tags */
+    void read(snapshot_reader& reader, size_t tags);
+};
+
+#endif /* POST_TABLE_H */
@@ -0,0 +1,129 @@
+#include "posting_index.h"
+
+#include "thread_pool.h"
+#include "util.h"
+
+#include <magic_enum.hpp>
+#include <spdlog/spdlog.h>
+
+using std::chrono::steady_clock;
+
+void posting_index::build(const post_table& posts, size_t tags, thread_pool& pool) {
+    auto begin = steady_clock::now();
+
+    _rows = posts.size();
+    _replaced.clear();
+
+    /* Uncompressed lists first, filled in row order so every list is ascending */
+    std::vector<uint32_t> offsets(tags + 1);
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        for (tag_id tag : posts.tags(type).values()) {
+            offsets[tag + 1] += 1;
+        }
+    }
+
+    for (size_t i = 0; i < tags; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<post_row> rows(offsets.back());
+    {
+        std::vector<uint32_t> cursors { offsets.begin(), offsets.end() - 1 };
+        for (post_row row = 0; row < _rows; ++row) {
+            for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                for (tag_id tag : posts.tags(type)[row]) {
+                    rows[cursors[tag]++] = row;
+                }
+            }
+        }
+    }
+
+    std::vector<posting_list> lists(tags);
+    pool.parallel_for(tags, [&](size_t tag) {
+        lists[tag] = posting_list::from_sorted(std::span { rows }.subspan(offsets[tag], offsets[tag + 1] - offsets[tag]));
+    }, 1024);
+
+    rows = {};
+
+    _container_offsets.assign(tags + 1, 0);
+    _array_offsets.assign(tags + 1, 0);
+    _bitmap_offsets.assign(tags + 1, 0);
+    for (size_t tag = 0; tag < tags; ++tag) {
+        _container_offsets[tag + 1] = _container_offsets[tag] + static_cast<uint32_t>(lists[tag].containers().size());
+        _array_offsets[tag + 1] = _array_offsets[tag] + static_cast<uint32_t>(lists[tag].arrays().size());
+        _bitmap_offsets[tag + 1] = _bitmap_offsets[tag] + static_cast<uint32_t>(lists[tag].bitmaps().size());
+    }
+
+    _containers.resize(_container_offsets.back());
+    _arrays.resize(_array_offsets.back());
+    _bitmaps.resize(_bitmap_offsets.back());
+
+    /* Offsets in the containers are relative to the list, so they're copied as they are */
+    pool.parallel_for(tags, [&](size_t tag) {
+        std::ranges::copy(lists[tag].containers(), _containers.begin() + _container_offsets[tag]);
+        std::ranges::copy(lists[tag].arrays(), _arrays.begin() + _array_offsets[tag]);
+        std::ranges::copy(lists[tag].bitmaps(), _bitmaps.begin() + _bitmap_offsets[tag]);
+
+        lists[tag] = {};
+    }, 1024);
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Indexed posts of {} tags ({} containers, {} bitmaps) in {}", tags, _containers.size(), _bitmaps.size() / posting_view::bitmap_words, end - begin);
+}
+
+posting_view posting_index::operator[](tag_id tag) const {
+    if (auto it = _replaced.find(tag); it != _replaced.end()) {
+        return it->second;
+    }
+
+    if (tag + size_t { 1 } >= _container_offsets.size()) {
+        return {};
+    }
+
+    auto containers = std::span { _containers }.subspan(_container_offsets[tag], _container_offsets[tag + 1] - _container_offsets[tag]);
+    auto arrays = std::span { _arrays }.subspan(_array_offsets[tag], _array_offsets[tag + 1] - _array_offsets[tag]);
+    auto bitmaps = std::span { _bitmaps }.subspan(_bitmap_offsets[tag], _bitmap_offsets[tag + 1] - _bitmap_offsets[tag]);
+
+    return { containers, arrays, bitmaps };
+}
+
+void posting_index::add(tag_id tag, post_row row) {
+    _replace(tag).add(row);
+}
+
+void posting_index::remove(tag_id tag, post_row row) {
+    _replace(tag).remove(row);
+}
+
+size_t posting_index::rows() const {
+    return _rows;
+}
+
+size_t posting_index::tags() const {
+    return _container_offsets.empty() ? 0 : (_container_offsets.size() - 1);
+}
+
+memory_footprint posting_index::footprint() const {
+    memory_footprint res;
+    res.owned += (_container_offsets.capacity() + _array_offsets.capacity() + _bitmap_offsets.capacity()) * sizeof(uint32_t);
+    res.owned += _containers.capacity() * sizeof(posting_container);
+    res.owned += _arrays.capacity() * sizeof(uint16_t);
+    res.owned += _bitmaps.capacity() * sizeof(uint64_t);
+
+    res.owned += node_container_bytes(_replaced);
+    for (const auto& [tag, list] : _replaced) {
+        res.owned += list.memory_usage();
+    }
+
+    return res;
+}
+
+posting_list& posting_index::_replace(tag_id tag) {
+    auto it = _replaced.find(tag);
+    if (it == _replaced.end()) {
+        it = _replaced.emplace(tag, posting_list { (*this)[tag] }).first;
+    }
+
+    return it->second;
+}
@@ -0,0 +1,50 @@
+#ifndef POSTING_INDEX_H
+#define POSTING_INDEX_H
+
+#include "memory_footprint.h"
+#include "posting_list.h"
+
+#include <unordered_map>
+#include <vector>
+
+class thread_pool;
+
+/* Inverted index from every tag to the posts it's on. The lists of all tags are stored back
+ * to back, lists changed afterwards are replaced by an owned copy.
+ */
+class posting_index {
+    size_t _rows = 0;
+
+    /* Where the containers, arrays and bitmaps of every tag start */
+    std::vector<uint32_t> _container_offsets;
+    std::vector<uint32_t> _array_offsets;
+    std::vector<uint32_t> _bitmap_offsets;
+
+    std::vector<posting_container> _containers;
+    std::vector<uint16_t> _arrays;
+    std::vector<uint64_t> _bitmaps;
+
+    /* Lists changed after building, these take precedence */
+    std::unordered_map<tag_id, posting_list> _replaced;
+
+    public:
+    /* Index all tags of all posts of a dictionary with tags tags */
+    void build(const post_table& posts, size_t tags, thread_pool& pool);
+
+    /* Posts of a tag, empty for unknown tags */
+    [[nodiscard]] posting_view operator[](tag_id tag) const;
+
+    void add(tag_id tag, post_row row);
+    void remove(tag_id tag, post_row row);
+
+    /* Rows and tags as built */
+    [[nodiscard]] size_t rows() const;
+    [[nodiscard]] size_t tags() const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    private:
+    [[nodiscard]] posting_list& _replace(tag_id tag);
+};
+
+#endif /* POSTING_INDEX_H */
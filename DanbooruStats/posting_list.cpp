@@ -0,0 +1,431 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+using bitmap_buffer = std::array<uint64_t, posting_view::bitmap_words>;
+
+[[nodiscard]] static uint32_t bitmap_cardinality(const uint64_t* words) {
+    /* Independent sums to hide the latency of popcount */
+    uint64_t sums[4] {};
+    for (size_t i = 0; i < posting_view::bitmap_words; i += 4) {
+        sums[0] += std::popcount(words[i + 0]);
+        sums[1] += std::popcount(words[i + 1]);
+        sums[2] += std::popcount(words[i + 2]);
+        sums[3] += std::popcount(words[i + 3]);
+    }
+
+    return static_cast<uint32_t>(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+[[nodiscard]] static bool test_bit(const uint64_t* words, uint16_t value) {
+    return (words[value / 64] >> (value % 64)) & 1;
+}
+
+static void set_bits(uint64_t* words, std::span<const uint16_t> values) {
+    for (uint16_t value : values) {
+        words[value / 64] |= uint64_t { 1 } << (value % 64);
+    }
+}
+
+static void bitmap_values(const uint64_t* words, std::vector<uint16_t>& values) {
+    for (size_t i = 0; i < posting_view::bitmap_words; ++i) {
+        for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+            values.push_back(static_cast<uint16_t>((i * 64) + std::countr_zero(word)));
+        }
+    }
+}
+
+/* Binary search the larger array when the sizes are far apart, merge otherwise */
+static void intersect_arrays(std::span<const uint16_t> l, std::span<const uint16_t> r, std::vector<uint16_t>& values) {
+    if (l.size() > r.size()) {
+        std::swap(l, r);
+    }
+
+    if (l.size() * 32 < r.size()) {
+        auto it = r.begin();
+        for (uint16_t value : l) {
+            it = std::lower_bound(it, r.end(), value);
+            if (it == r.end()) {
+                break;
+            }
+
+            if (*it == value) {
+                values.push_back(value);
+            }
+        }
+    } else {
+        std::ranges::set_intersection(l, r, std::back_inserter(values));
+    }
+}
+
+static void append_container(posting_list& res, posting_view source, const posting_container& container) {
+    if (container.is_bitmap) {
+        res.append_bitmap(container.key, source.bitmap(container), container.cardinality);
+    } else {
+        res.append_array(container.key, source.array(container));
+    }
+}
+
+size_t posting_view::size() const {
+    size_t res = 0;
+    for (const posting_container& container : _containers) {
+        res += container.cardinality;
+    }
+
+    return res;
+}
+
+bool posting_view::contains(post_row row) const {
+    auto key = static_cast<uint16_t>(row >> 16);
+    auto low = static_cast<uint16_t>(row & 0xFFFF);
+
+    auto it = std::ranges::lower_bound(_containers, key, {}, &posting_container::key);
+    if (it == _containers.end() || it->key != key) {
+        return false;
+    }
+
+    return it->is_bitmap ? test_bit(bitmap(*it), low) : std::ranges::binary_search(array(*it), low);
+}
+
+std::span<const uint16_t> posting_view::array(const posting_container& container) const {
+    return _arrays.subspan(container.offset, container.cardinality);
+}
+
+const uint64_t* posting_view::bitmap(const posting_container& container) const {
+    return _bitmaps.data() + container.offset;
+}
+
+posting_view posting_view::chunk(size_t i) const {
+    return { _containers.subspan(i, 1), _arrays, _bitmaps };
+}
+
+posting_list::posting_list(posting_view view) {
+    for (const posting_container& container : view.containers()) {
+        _append_copy(view, container);
+    }
+}
+
+posting_list posting_list::from_sorted(std::span<const post_row> rows) {
+    posting_list res;
+
+    std::vector<uint16_t> values;
+    for (size_t i = 0; i < rows.size();) {
+        auto key = static_cast<uint16_t>(rows[i] >> 16);
+
+        values.clear();
+        for (; i < rows.size() && (rows[i] >> 16) == key; ++i) {
+            values.push_back(static_cast<uint16_t>(rows[i] & 0xFFFF));
+        }
+
+        res.append_array(key, values);
+    }
+
+    return res;
+}
+
+posting_view posting_list::view() const {
+    return { _containers, _arrays, _bitmaps };
+}
+
+void posting_list::add(post_row row) {
+    auto key = static_cast<uint16_t>(row >> 16);
+    auto low = static_cast<uint16_t>(row & 0xFFFF);
+
+    auto it = std::ranges::lower_bound(_containers, key, {}, &posting_container::key);
+    size_t index = static_cast<size_t>(it - _containers.begin());
+
+    if (it == _containers.end() || it->key != key) {
+        /* Arrays are stored in container order, so it goes before the next array */
+        auto next = std::find_if(it, _containers.end(), [](const posting_container& container) { return !container.is_bitmap; });
+        auto offset = static_cast<uint32_t>((next == _containers.end()) ? _arrays.size() : next->offset);
+
+        _arrays.insert(_arrays.begin() + offset, low);
+        _shift_offsets(index, false, 1);
+        _containers.insert(_containers.begin() + index, { key, false, 1, offset });
+        return;
+    }
+
+    /* Containers keep their form, this is for a few changes at a time */
+    posting_container& container = *it;
+    if (container.is_bitmap) {
+        uint64_t& word = _bitmaps[container.offset + (low / 64)];
+        uint64_t bit = uint64_t { 1 } << (low % 64);
+        if ((word & bit) == 0) {
+            word |= bit;
+            container.cardinality += 1;
+        }
+    } else {
+        auto first = _arrays.begin() + container.offset;
+        auto pos = std::lower_bound(first, first + container.cardinality, low);
+        if (pos != first + container.cardinality && *pos == low) {
+            return;
+        }
+
+        _arrays.insert(pos, low);
+        container.cardinality += 1;
+        _shift_offsets(index + 1, false, 1);
+    }
+}
+
+void posting_list::remove(post_row row) {
+    auto key = static_cast<uint16_t>(row >> 16);
+    auto low = static_cast<uint16_t>(row & 0xFFFF);
+
+    auto it = std::ranges::lower_bound(_containers, key, {}, &posting_container::key);
+    if (it == _containers.end() || it->key != key) {
+        return;
+    }
+
+    size_t index = static_cast<size_t>(it - _containers.begin());
+
+    posting_container& container = *it;
+    if (container.is_bitmap) {
+        uint64_t& word = _bitmaps[container.offset + (low / 64)];
+        uint64_t bit = uint64_t { 1 } << (low % 64);
+        if ((word & bit) == 0) {
+            return;
+        }
+
+        word &= ~bit;
+        container.cardinality -= 1;
+
+        if (container.cardinality == 0) {
+            auto first = _bitmaps.begin() + container.offset;
+            _bitmaps.erase(first, first + posting_view::bitmap_words);
+            _shift_offsets(index + 1, true, -static_cast<int64_t>(posting_view::bitmap_words));
+            _containers.erase(it);
+        }
+    } else {
+        auto first = _arrays.begin() + container.offset;
+        auto pos = std::lower_bound(first, first + container.cardinality, low);
+        if (pos == first + container.cardinality || *pos != low) {
+            return;
+        }
+
+        _arrays.erase(pos);
+        container.cardinality -= 1;
+        _shift_offsets(index + 1, false, -1);
+
+        if (container.cardinality == 0) {
+            _containers.erase(it);
+        }
+    }
+}
+
+size_t posting_list::memory_usage() const {
+    return (_containers.capacity() * sizeof(posting_container))
+        + (_arrays.capacity() * sizeof(uint16_t))
+        + (_bitmaps.capacity() * sizeof(uint64_t));
+}
+
+void posting_list::append_array(uint16_t key, std::span<const uint16_t> values) {
+    if (values.empty()) {
+        return;
+    }
+
+    if (values.size() > posting_view::array_max) {
+        bitmap_buffer words {};
+        set_bits(words.data(), values);
+        append_bitmap(key, words.data(), static_cast<uint32_t>(values.size()));
+        return;
+    }
+
+    _containers.push_back({ key, false, static_cast<uint32_t>(values.size()), static_cast<uint32_t>(_arrays.size()) });
+    _arrays.insert(_arrays.end(), values.begin(), values.end());
+}
+
+void posting_list::append_bitmap(uint16_t key, const uint64_t* words, uint32_t cardinality) {
+    if (cardinality == 0) {
+        return;
+    }
+
+    if (cardinality <= posting_view::array_max) {
+        auto offset = static_cast<uint32_t>(_arrays.size());
+
+        std::vector<uint16_t> values;
+        values.reserve(cardinality);
+        bitmap_values(words, values);
+
+        _containers.push_back({ key, false, cardinality, offset });
+        _arrays.insert(_arrays.end(), values.begin(), values.end());
+        return;
+    }
+
+    _containers.push_back({ key, true, cardinality, static_cast<uint32_t>(_bitmaps.size()) });
+    _bitmaps.insert(_bitmaps.end(), words, words + posting_view::bitmap_words);
+}
+
+void posting_list::_append_copy(posting_view source, const posting_container& container) {
+    posting_container copy = container;
+    if (container.is_bitmap) {
+        copy.offset = static_cast<uint32_t>(_bitmaps.size());
+
+        const uint64_t* words = source.bitmap(container);
+        _bitmaps.insert(_bitmaps.end(), words, words + posting_view::bitmap_words);
+    } else {
+        copy.offset = static_cast<uint32_t>(_arrays.size());
+
+        auto values = source.array(container);
+        _arrays.insert(_arrays.end(), values.begin(), values.end());
+    }
+
+    _containers.push_back(copy);
+}
+
+void posting_list::_shift_offsets(size_t after, bool is_bitmap, int64_t delta) {
+    for (size_t i = after; i < _containers.size(); ++i) {
+        if (_containers[i].is_bitmap == is_bitmap) {
+            _containers[i].offset = static_cast<uint32_t>(_containers[i].offset + delta);
+        }
+    }
+}
+
+posting_list intersect(posting_view l, posting_view r) {
+    posting_list res;
+
+    std::vector<uint16_t> values;
+    bitmap_buffer words;
+
+    auto lc = l.containers();
+    auto rc = r.containers();
+    for (size_t i = 0, j = 0; i < lc.size() && j < rc.size();) {
+        if (lc[i].key < rc[j].key) {
+            ++i;
+            continue;
+        } else if (rc[j].key < lc[i].key) {
+            ++j;
+            continue;
+        }
+
+        const posting_container& a = lc[i++];
+        const posting_container& b = rc[j++];
+
+        values.clear();
+        if (a.is_bitmap && b.is_bitmap) {
+            const uint64_t* x = l.bitmap(a);
+            const uint64_t* y = r.bitmap(b);
+            for (size_t k = 0; k < posting_view::bitmap_words; ++k) {
+                words[k] = x[k] & y[k];
+            }
+
+            res.append_bitmap(a.key, words.data(), bitmap_cardinality(words.data()));
+        } else if (a.is_bitmap || b.is_bitmap) {
+            const uint64_t* bitmap = a.is_bitmap ? l.bitmap(a) : r.bitmap(b);
+            for (uint16_t value : a.is_bitmap ? r.array(b) : l.array(a)) {
+                if (test_bit(bitmap, value)) {
+                    values.push_back(value);
+                }
+            }
+
+            res.append_array(a.key, values);
+        } else {
+            intersect_arrays(l.array(a), r.array(b), values);
+            res.append_array(a.key, values);
+        }
+    }
+
+    return res;
+}
+
+posting_list unite(posting_view l, posting_view r) {
+    posting_list res;
+
+    std::vector<uint16_t> values;
+    bitmap_buffer words;
+
+    auto lc = l.containers();
+    auto rc = r.containers();
+    for (size_t i = 0, j = 0; i < lc.size() || j < rc.size();) {
+        if (j == rc.size() || (i < lc.size() && lc[i].key < rc[j].key)) {
+            append_container(res, l, lc[i++]);
+            continue;
+        }
+
+        if (i == lc.size() || rc[j].key < lc[i].key) {
+            append_container(res, r, rc[j++]);
+            continue;
+        }
+
+        const posting_container& a = lc[i++];
+        const posting_container& b = rc[j++];
+
+        if (a.is_bitmap || b.is_bitmap) {
+            words.fill(0);
+            for (auto [view, container] : { std::pair { l, a }, std::pair { r, b } }) {
+                if (container.is_bitmap) {
+                    const uint64_t* x = view.bitmap(container);
+                    for (size_t k = 0; k < posting_view::bitmap_words; ++k) {
+                        words[k] |= x[k];
+                    }
+                } else {
+                    set_bits(words.data(), view.array(container));
+                }
+            }
+
+            res.append_bitmap(a.key, words.data(), bitmap_cardinality(words.data()));
+        } else {
+            values.clear();
+            std::ranges::set_union(l.array(a), r.array(b), std::back_inserter(values));
+            res.append_array(a.key, values);
+        }
+    }
+
+    return res;
+}
+
+posting_list subtract(posting_view l, posting_view r) {
+    posting_list res;
+
+    std::vector<uint16_t> values;
+    bitmap_buffer words;
+
+    auto lc = l.containers();
+    auto rc = r.containers();
+    for (size_t i = 0, j = 0; i < lc.size(); ++i) {
+        const posting_container& a = lc[i];
+        while (j < rc.size() && rc[j].key < a.key) {
+            ++j;
+        }
+
+        if (j == rc.size() || rc[j].key != a.key) {
+            append_container(res, l, a);
+            continue;
+        }
+
+        const posting_container& b = rc[j];
+
+        if (a.is_bitmap) {
+            std::copy_n(l.bitmap(a), posting_view::bitmap_words, words.begin());
+            if (b.is_bitmap) {
+                const uint64_t* y = r.bitmap(b);
+                for (size_t k = 0; k < posting_view::bitmap_words; ++k) {
+                    words[k] &= ~y[k];
+                }
+            } else {
+                for (uint16_t value : r.array(b)) {
+                    words[value / 64] &= ~(uint64_t { 1 } << (value % 64));
+                }
+            }
+
+            res.append_bitmap(a.key, words.data(), bitmap_cardinality(words.data()));
+        } else {
+            values.clear();
+            if (b.is_bitmap) {
+                const uint64_t* y = r.bitmap(b);
+                for (uint16_t value : l.array(a)) {
+                    if (!test_bit(y, value)) {
+                        values.push_back(value);
+                    }
+                }
+            } else {
+                std::ranges::set_difference(l.array(a), r.array(b), std::back_inserter(values));
+            }
+
+            res.append_array(a.key, values);
+        }
+    }
+
+    return res;
+}
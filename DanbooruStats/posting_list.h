@@ -0,0 +1,122 @@
+#ifndef POSTING_LIST_H
+#define POSTING_LIST_H
+
+#include "post_table.h"
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/* Rows with the same high 16 bits, stored as a sorted array of the low 16 bits
+ * or as a bitmap of all 65536, whichever is smaller.
+ */
+struct posting_container {
+    uint16_t key;
+    bool is_bitmap;
+    uint32_t cardinality;
+
+    /* Into the arrays or bitmaps of the list, in elements */
+    uint32_t offset;
+};
+
+/* A set of post rows in roaring-style containers, referring to storage owned elsewhere */
+class posting_view {
+    public:
+    static constexpr size_t chunk_size = 65536;
+    static constexpr size_t bitmap_words = chunk_size / 64;
+
+    /* Larger arrays take more space than a bitmap */
+    static constexpr uint32_t array_max = 4096;
+
+    private:
+    std::span<const posting_container> _containers;
+    std::span<const uint16_t> _arrays;
+    std::span<const uint64_t> _bitmaps;
+
+    public:
+    posting_view() = default;
+    posting_view(std::span<const posting_container> containers, std::span<const uint16_t> arrays, std::span<const uint64_t> bitmaps)
+        : _containers { containers }, _arrays { arrays }, _bitmaps { bitmaps } { }
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const { return _containers.empty(); }
+    [[nodiscard]] bool contains(post_row row) const;
+
+    [[nodiscard]] std::span<const posting_container> containers() const { return _containers; }
+    [[nodiscard]] std::span<const uint16_t> array(const posting_container& container) const;
+    [[nodiscard]] const uint64_t* bitmap(const posting_container& container) const;
+
+    /* Only the i-th container */
+    [[nodiscard]] posting_view chunk(size_t i) const;
+
+    /* Call f for every row, ascending */
+    template <typename F>
+    void for_each(F&& f) const;
+};
+
+/* A set of post rows owning it's containers */
+class posting_list {
+    std::vector<posting_container> _containers;
+    std::vector<uint16_t> _arrays;
+    std::vector<uint64_t> _bitmaps;
+
+    public:
+    posting_list() = default;
+    explicit posting_list(posting_view view);
+
+    /* Rows must be ascending without duplicates */
+    [[nodiscard]] static posting_list from_sorted(std::span<const post_row> rows);
+
+    [[nodiscard]] posting_view view() const;
+    operator posting_view() const { return view(); }
+
+    [[nodiscard]] size_t size() const { return view().size(); }
+    [[nodiscard]] bool empty() const { return _containers.empty(); }
+
+    void add(post_row row);
+    void remove(post_row row);
+
+    [[nodiscard]] std::span<const posting_container> containers() const { return _containers; }
+    [[nodiscard]] std::span<const uint16_t> arrays() const { return _arrays; }
+    [[nodiscard]] std::span<const uint64_t> bitmaps() const { return _bitmaps; }
+
+    [[nodiscard]] size_t memory_usage() const;
+
+    /* Append a container after all others, in whichever form fits the cardinality. Empty ones are skipped. */
+    void append_array(uint16_t key, std::span<const uint16_t> values);
+    void append_bitmap(uint16_t key, const uint64_t* words, uint32_t cardinality);
+
+    private:
+    void _append_copy(posting_view source, const posting_container& container);
+    void _shift_offsets(size_t after, bool is_bitmap, int64_t delta);
+};
+
+/* Boolean operations, working one container at a time. Bitmap pairs are combined word by
+ * word in fixed-length loops that compilers vectorize.
+ */
+[[nodiscard]] posting_list intersect(posting_view l, posting_view r);
+[[nodiscard]] posting_list unite(posting_view l, posting_view r);
+[[nodiscard]] posting_list subtract(posting_view l, posting_view r);
+
+template <typename F>
+void posting_view::for_each(F&& f) const {
+    for (const posting_container& container : _containers) {
+        post_row base = post_row { container.key } << 16;
+
+        if (container.is_bitmap) {
+            const uint64_t* words = bitmap(container);
+            for (size_t i = 0; i < bitmap_words; ++i) {
+                for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                    f(static_cast<post_row>(base + (i * 64) + std::countr_zero(word)));
+                }
+            }
+        } else {
+            for (uint16_t low : array(container)) {
+                f(base + low);
+            }
+        }
+    }
+}
+
+#endif /* POSTING_LIST_H */
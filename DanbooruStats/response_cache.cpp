@@ -0,0 +1,204 @@
+#include "response_cache.h"
+
+#include <spdlog/spdlog.h>
+
+#include <format>
+
+response_cache::response_cache(size_t budget) : _budget { budget } {
+
+}
+
+uint64_t response_cache::generation() const {
+    return _generation.load(std::memory_order_acquire);
+}
+
+response_cache::value_type response_cache::find(const std::string& key, uint64_t version, std::chrono::steady_clock::duration max_age) {
+    std::scoped_lock lock { _lock };
+
+    _advance(version);
+
+    auto it = _entries.find(key);
+    if (it == _entries.end() || version != _version) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    if (std::chrono::steady_clock::now() - it->second.created > max_age) {
+        _erase(it);
+        _invalidations.fetch_add(1, std::memory_order_relaxed);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+
+    return it->second.value;
+}
+
+std::pair<response_cache::value_type, bool> response_cache::insert(std::string key, uint64_t version, uint64_t generation, size_t source, std::string body, std::string content_type) {
+    std::string etag = make_etag(body);
+    auto value = std::make_shared<const cached_response>(std::move(body), std::move(content_type), std::move(etag));
+
+    if (_budget == 0 || value->body.size() > _budget) {
+        return { value, false };
+    }
+
+    std::scoped_lock lock { _lock };
+
+    _advance(version);
+
+    /* Rendered from an older dataset or template than what's current now */
+    if (version != _version || generation != _generation.load(std::memory_order_relaxed)) {
+        return { value, false };
+    }
+
+    if (auto it = _entries.find(key); it != _entries.end()) {
+        _erase(it);
+    }
+
+    _lru.push_front(key);
+    _entries.emplace(std::move(key), entry { .value = value, .source = source, .created = std::chrono::steady_clock::now(), .lru = _lru.begin() });
+    _bytes += value->body.size();
+
+    /* It fits by itself and is the most recently used, so only older entries are evicted */
+    _evict();
+
+    return { value, true };
+}
+
+void response_cache::invalidate(size_t source) {
+    std::scoped_lock lock { _lock };
+
+    _generation.fetch_add(1, std::memory_order_release);
+
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->second.source == source) {
+            auto next = std::next(it);
+            _erase(it);
+            it = next;
+
+            _invalidations.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void response_cache::count_not_modified() {
+    _not_modified.fetch_add(1, std::memory_order_relaxed);
+}
+
+response_cache::counters response_cache::stats() const {
+    std::scoped_lock lock { _lock };
+
+    return {
+        .hits = _hits.load(std::memory_order_relaxed),
+        .misses = _misses.load(std::memory_order_relaxed),
+        .not_modified = _not_modified.load(std::memory_order_relaxed),
+        .invalidations = _invalidations.load(std::memory_order_relaxed),
+        .evictions = _evictions.load(std::memory_order_relaxed),
+        .entries = _entries.size(),
+        .bytes = _bytes,
+        .budget = _budget,
+    };
+}
+
+memory_footprint response_cache::footprint() const {
+    std::scoped_lock lock { _lock };
+
+    /* Keys are stored twice, in the map and in _lru. Compressed bodies aren't part of the budget */
+    size_t extra = 0;
+    for (const auto& [key, entry] : _entries) {
+        extra += 2 * key.capacity() + entry.value->content_type.capacity() + entry.value->etag.capacity();
+        extra += sizeof(cached_response) + entry.value->encoded.memory_usage();
+    }
+
+    return { .owned = _bytes + extra + node_container_bytes(_entries) + node_container_bytes(_lru) };
+}
+
+void response_cache::clear() {
+    std::scoped_lock lock { _lock };
+
+    _generation.fetch_add(1, std::memory_order_release);
+    _invalidations.fetch_add(_entries.size(), std::memory_order_relaxed);
+
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0;
+}
+
+std::string response_cache::make_etag(std::string_view body) {
+    /* FNV-1a, plus the length to make collisions between pages even less likely */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : body) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+
+    return std::format("\"{:016x}-{:x}\"", hash, body.size());
+}
+
+bool response_cache::matches(std::string_view if_none_match, std::string_view etag) {
+    while (!if_none_match.empty()) {
+        size_t end = if_none_match.find(',');
+        std::string_view candidate = if_none_match.substr(0, end);
+        if_none_match.remove_prefix(end == std::string_view::npos ? if_none_match.size() : end + 1);
+
+        size_t first = candidate.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+
+        candidate = candidate.substr(first, candidate.find_last_not_of(" \t") + 1 - first);
+
+        if (candidate == "*") {
+            return true;
+        }
+
+        /* If-None-Match uses weak comparison, so W/"x" matches "x" */
+        if (candidate.starts_with("W/")) {
+            candidate.remove_prefix(2);
+        }
+
+        if (candidate == etag) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void response_cache::_advance(uint64_t version) {
+    if (version <= _version) {
+        return;
+    }
+
+    if (!_entries.empty()) {
+        spdlog::debug("Dataset changed, dropping {} cached responses", _entries.size());
+    }
+
+    _invalidations.fetch_add(_entries.size(), std::memory_order_relaxed);
+
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0;
+
+    _version = version;
+}
+
+void response_cache::_evict() {
+    while (_bytes > _budget && !_lru.empty()) {
+        auto it = _entries.find(_lru.back());
+
+        spdlog::debug("Evicting response {} ({} bytes)", it->first, it->second.value->body.size());
+
+        _erase(it);
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void response_cache::_erase(std::unordered_map<std::string, entry>::iterator it) {
+    _bytes -= it->second.value->body.size();
+    _lru.erase(it->second.lru);
+    _entries.erase(it);
+}
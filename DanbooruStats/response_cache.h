@@ -0,0 +1,123 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "compression.h"
+#include "memory_footprint.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/* A rendered response, only its compressed forms are added once cached */
+struct cached_response {
+    std::string body;
+    std::string content_type;
+
+    /* Strong validator of the body, quoted as sent in the ETag header */
+    std::string etag;
+
+    mutable encoded_bodies encoded;
+};
+
+/* Thread-safe LRU cache of rendered responses by route and parameters, bounded by the size of the
+ * bodies. Every response is rendered from a source (a template) and a version of the dataset:
+ * invalidating a source drops what was rendered from it, and a newer version drops everything.
+ */
+class response_cache {
+    public:
+    using value_type = std::shared_ptr<const cached_response>;
+
+    struct counters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t not_modified;
+        uint64_t invalidations;
+        uint64_t evictions;
+
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+
+    private:
+    struct entry {
+        value_type value;
+        size_t source;
+        std::chrono::steady_clock::time_point created;
+
+        /* Position in _lru */
+        std::list<std::string>::iterator lru;
+    };
+
+    mutable std::mutex _lock;
+    std::unordered_map<std::string, entry> _entries;
+
+    /* Most recently used first */
+    std::list<std::string> _lru;
+
+    /* Dataset version of every entry */
+    uint64_t _version = 0;
+
+    /* Incremented by every invalidation, so responses rendered before one aren't cached */
+    std::atomic<uint64_t> _generation { 0 };
+
+    size_t _budget;
+    size_t _bytes = 0;
+
+    std::atomic<uint64_t> _hits { 0 };
+    std::atomic<uint64_t> _misses { 0 };
+    std::atomic<uint64_t> _not_modified { 0 };
+    std::atomic<uint64_t> _invalidations { 0 };
+    std::atomic<uint64_t> _evictions { 0 };
+
+    public:
+    /* A budget of 0 disables caching, responses still get their ETag */
+    explicit response_cache(size_t budget);
+
+    /* Take before rendering, and pass to insert */
+    [[nodiscard]] uint64_t generation() const;
+
+    /* The response for key rendered from the dataset at version at most max_age ago, nullptr if there's none */
+    [[nodiscard]] value_type find(const std::string& key, uint64_t version,
+        std::chrono::steady_clock::duration max_age = std::chrono::steady_clock::duration::max());
+
+    /* Cache a response unless it's already outdated, either way it's returned with its ETag.
+     * The bool is whether it was cached.
+     */
+    std::pair<value_type, bool> insert(std::string key, uint64_t version, uint64_t generation, size_t source, std::string body, std::string content_type);
+
+    /* Drop everything rendered from source */
+    void invalidate(size_t source);
+
+    /* Count a request answered with 304 Not Modified */
+    void count_not_modified();
+
+    [[nodiscard]] counters stats() const;
+    [[nodiscard]] memory_footprint footprint() const;
+
+    void clear();
+
+    /* Quoted hash of the body, the same for the same body across restarts */
+    [[nodiscard]] static std::string make_etag(std::string_view body);
+
+    /* Whether an If-None-Match header value matches etag, using weak comparison as required */
+    [[nodiscard]] static bool matches(std::string_view if_none_match, std::string_view etag);
+
+    private:
+    /* Drop all entries for a newer dataset version, requires _lock */
+    void _advance(uint64_t version);
+
+    /* Evict least recently used entries until we're within budget, requires _lock */
+    void _evict();
+
+    /* Requires _lock */
+    void _erase(std::unordered_map<std::string, entry>::iterator it);
+};
+
+#endif /* RESPONSE_CACHE_H */
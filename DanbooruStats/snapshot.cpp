@@ -0,0 +1,68 @@
+#include "snapshot.h"
+
+#include <format>
+
+snapshot_writer::snapshot_writer(const std::string& path)
+    : _out { path, std::ios::binary | std::ios::trunc } {
+    if (!_out) {
+        throw std::runtime_error { std::format("Failed to open {} for writing", path) };
+    }
+
+    _out.exceptions(std::ios::failbit | std::ios::badbit);
+
+    snapshot_header header {
+        .magic = snapshot_magic,
+        .version = snapshot_version,
+        .byte_order = snapshot_byte_order,
+    };
+
+    _write_bytes(&header, sizeof(header));
+}
+
+void snapshot_writer::_write_bytes(const void* data, size_t size) {
+    _out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    _offset += size;
+}
+
+void snapshot_writer::_pad(size_t alignment) {
+    static constexpr std::array<char, snapshot_alignment> zeroes {};
+
+    size_t padding = (alignment - (_offset % alignment)) % alignment;
+    _write_bytes(zeroes.data(), padding);
+}
+
+snapshot_reader::snapshot_reader(std::span<const std::byte> data) : _data { data } {
+    if (_data.size() < sizeof(snapshot_header)) {
+        throw std::runtime_error { "Truncated snapshot" };
+    }
+
+    snapshot_header header;
+    std::memcpy(&header, _data.data(), sizeof(header));
+
+    if (header.magic != snapshot_magic) {
+        throw std::runtime_error { "Not a snapshot" };
+    }
+
+    if (header.version != snapshot_version) {
+        throw std::runtime_error { std::format("Snapshot version {} is not supported, expected {}", header.version, snapshot_version) };
+    }
+
+    if (header.byte_order != snapshot_byte_order) {
+        throw std::runtime_error { "Snapshot was written on a machine with a different byte order" };
+    }
+
+    _offset = sizeof(header);
+}
+
+bool snapshot_reader::is_snapshot(const std::string& path) {
+    std::ifstream in { path, std::ios::binary };
+
+    std::array<char, snapshot_magic.size()> magic {};
+    in.read(magic.data(), magic.size());
+
+    return in && magic == snapshot_magic;
+}
+
+void snapshot_reader::_align(size_t alignment) {
+    _offset += (alignment - (_offset % alignment)) % alignment;
+}
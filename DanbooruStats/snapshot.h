@@ -0,0 +1,117 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/* A snapshot is a header followed by a sequence of arrays. Every array is preceded by it's
+ * size in bytes and aligned to snapshot_alignment, so they can be used in place once mapped.
+ * Readers and writers must agree on the order, bump snapshot_version when it changes.
+ */
+static constexpr std::array<char, 8> snapshot_magic { 'D', 'B', 'S', 'N', 'A', 'P', '\0', '\0' };
+static constexpr uint32_t snapshot_version = 3;
+static constexpr size_t snapshot_alignment = 64;
+
+struct snapshot_header {
+    std::array<char, 8> magic;
+    uint32_t version;
+
+    /* Snapshots are only usable on machines with the same byte order */
+    uint32_t byte_order;
+};
+
+static constexpr uint32_t snapshot_byte_order = 0x01020304;
+
+class snapshot_writer {
+    std::ofstream _out;
+    uint64_t _offset = 0;
+
+    public:
+    explicit snapshot_writer(const std::string& path);
+
+    template <typename T>
+    void write(std::span<const T> data);
+
+    template <typename T>
+    void write_value(const T& value) {
+        write(std::span<const T> { &value, 1 });
+    }
+
+    private:
+    void _write_bytes(const void* data, size_t size);
+    void _pad(size_t alignment);
+};
+
+class snapshot_reader {
+    std::span<const std::byte> _data;
+    size_t _offset = 0;
+
+    public:
+    /* Throws if the header doesn't match this build */
+    explicit snapshot_reader(std::span<const std::byte> data);
+
+    template <typename T>
+    [[nodiscard]] std::span<const T> read();
+
+    template <typename T>
+    [[nodiscard]] const T& read_value() {
+        auto res = read<T>();
+        if (res.size() != 1) {
+            throw std::runtime_error { "Snapshot value has the wrong size" };
+        }
+
+        return res.front();
+    }
+
+    /* Check the magic bytes at the start of a file */
+    [[nodiscard]] static bool is_snapshot(const std::string& path);
+
+    private:
+    void _align(size_t alignment);
+};
+
+template <typename T>
+void snapshot_writer::write(std::span<const T> data) {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshot arrays are used in place");
+
+    uint64_t bytes = data.size_bytes();
+
+    _pad(alignof(uint64_t));
+    _write_bytes(&bytes, sizeof(bytes));
+    _pad(snapshot_alignment);
+    _write_bytes(data.data(), data.size_bytes());
+}
+
+template <typename T>
+std::span<const T> snapshot_reader::read() {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshot arrays are used in place");
+    static_assert(alignof(T) <= snapshot_alignment);
+
+    _align(alignof(uint64_t));
+    if (_offset + sizeof(uint64_t) > _data.size()) {
+        throw std::runtime_error { "Truncated snapshot" };
+    }
+
+    uint64_t bytes;
+    std::memcpy(&bytes, _data.data() + _offset, sizeof(bytes));
+    _offset += sizeof(bytes);
+
+    _align(snapshot_alignment);
+    if (bytes % sizeof(T) != 0 || _offset + bytes > _data.size()) {
+        throw std::runtime_error { "Corrupt snapshot" };
+    }
+
+    const T* begin = reinterpret_cast<const T*>(_data.data() + _offset);
+    _offset += bytes;
+
+    return { begin, static_cast<size_t>(bytes / sizeof(T)) };
+}
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,312 @@
+#include "tag_catalog.h"
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+static constexpr std::array<char, 8> catalog_magic { 'T', 'A', 'G', 'C', 'A', 'T', '\0', '\0' };
+static constexpr uint32_t catalog_version = 1;
+
+/* Average names per bucket, and the share of the table in use */
+static constexpr double bucket_size = 4.;
+static constexpr double load_factor = 0.99;
+
+/* Seeds tried before giving up, every one has a good chance */
+static constexpr uint64_t max_seeds = 16;
+static constexpr uint32_t max_pilot = 1 << 24;
+
+struct catalog_header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t size;
+    uint64_t seed;
+    uint64_t table_size;
+};
+
+static uint64_t mix(uint64_t x) {
+    /* splitmix64 finalizer */
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Stable across builds and platforms, unlike std::hash */
+static uint64_t hash_name(std::string_view name, uint64_t seed) {
+    uint64_t res = mix(seed ^ name.size());
+
+    size_t i = 0;
+    for (; i + 8 <= name.size(); i += 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, name.data() + i, sizeof(chunk));
+        res = mix(res ^ chunk);
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, name.data() + i, name.size() - i);
+
+    return mix(res ^ tail ^ 0x9E3779B97F4A7C15ull);
+}
+
+/* Pilots written for a number of tags */
+static uint64_t bucket_count(uint64_t size) {
+    return std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(size) / bucket_size), 1);
+}
+
+static uint64_t bucket_of(uint64_t hash, uint64_t buckets) {
+    return (hash >> 32) % buckets;
+}
+
+static uint64_t position_of(uint64_t hash, uint32_t pilot, uint64_t seed, uint64_t table_size) {
+    return (hash ^ mix(seed + pilot)) % table_size;
+}
+
+tag_catalog::tag_catalog(const std::string& path) : _file { std::make_unique<mapped_file>(path) } {
+    snapshot_reader reader { _file->data() };
+
+    const auto& header = reader.read_value<catalog_header>();
+    if (header.magic != catalog_magic) {
+        throw std::runtime_error { std::format("{} is not a tag catalog", path) };
+    }
+
+    if (header.version != catalog_version) {
+        throw std::runtime_error { std::format("Tag catalog version {} is not supported, expected {}", header.version, catalog_version) };
+    }
+
+    _seed = header.seed;
+    _table_size = header.table_size;
+
+    _pilots = reader.read<uint32_t>();
+    _remap = reader.read<uint32_t>();
+    _name_offsets = reader.read<uint32_t>();
+    _names = reader.read<char>();
+    _ids = reader.read<int32_t>();
+    _post_counts = reader.read<int32_t>();
+    _categories = reader.read<uint8_t>();
+
+    size_t size = header.size;
+    bool valid = (_name_offsets.size() == size + 1) && (_ids.size() == size) && (_post_counts.size() == size) && (_categories.size() == size)
+        && (size == 0 || (_pilots.size() == bucket_count(size) && _table_size >= size && _remap.size() == _table_size - size))
+        && (_name_offsets.front() == 0) && (_name_offsets.back() == _names.size()) && std::ranges::is_sorted(_name_offsets)
+        && std::ranges::all_of(_remap, [size](uint32_t slot) { return slot < size; });
+
+    if (!valid) {
+        throw std::runtime_error { std::format("Corrupt tag catalog {}", path) };
+    }
+}
+
+/* Slot of every tag for a seed, if one is found */
+static std::optional<std::vector<uint32_t>> place(std::span<const uint64_t> hashes, uint64_t seed, uint64_t buckets, uint64_t table_size, std::vector<uint32_t>& pilots, std::vector<uint32_t>& remap) {
+    size_t size = hashes.size();
+
+    /* Names grouped by bucket, largest buckets are placed first while the table is empty */
+    std::vector<uint32_t> offsets(buckets + 1);
+    for (uint64_t hash : hashes) {
+        offsets[bucket_of(hash, buckets) + 1] += 1;
+    }
+
+    std::vector<uint32_t> bucket_order(buckets);
+    std::iota(bucket_order.begin(), bucket_order.end(), 0);
+    std::ranges::stable_sort(bucket_order, std::ranges::greater {}, [&](uint32_t bucket) { return offsets[bucket + 1]; });
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> members(size);
+    std::vector<uint32_t> filled { offsets.begin(), offsets.end() - 1 };
+    for (uint32_t i = 0; i < size; ++i) {
+        members[filled[bucket_of(hashes[i], buckets)]++] = i;
+    }
+
+    std::vector<bool> taken(table_size);
+    std::vector<uint64_t> positions(size);
+    std::vector<uint64_t> candidate;
+
+    pilots.assign(buckets, 0);
+    for (uint32_t bucket : bucket_order) {
+        std::span<const uint32_t> bucket_members { members.data() + offsets[bucket], offsets[bucket + 1] - offsets[bucket] };
+        if (bucket_members.empty()) {
+            break;
+        }
+
+        uint32_t pilot = 0;
+        for (;; ++pilot) {
+            if (pilot == max_pilot) {
+                return std::nullopt;
+            }
+
+            candidate.clear();
+            for (uint32_t member : bucket_members) {
+                uint64_t position = position_of(hashes[member], pilot, seed, table_size);
+                if (taken[position] || std::ranges::find(candidate, position) != candidate.end()) {
+                    break;
+                }
+
+                candidate.push_back(position);
+            }
+
+            if (candidate.size() == bucket_members.size()) {
+                break;
+            }
+        }
+
+        pilots[bucket] = pilot;
+        for (size_t i = 0; i < bucket_members.size(); ++i) {
+            taken[candidate[i]] = true;
+            positions[bucket_members[i]] = candidate[i];
+        }
+    }
+
+    /* Positions past the end take the holes below it, in order */
+    remap.assign(table_size - size, 0);
+    uint64_t hole = 0;
+    for (uint64_t position = size; position < table_size; ++position) {
+        if (taken[position]) {
+            while (taken[hole]) {
+                ++hole;
+            }
+
+            remap[position - size] = static_cast<uint32_t>(hole++);
+        }
+    }
+
+    std::vector<uint32_t> slots(size);
+    for (size_t i = 0; i < size; ++i) {
+        slots[i] = (positions[i] < size) ? static_cast<uint32_t>(positions[i]) : remap[positions[i] - size];
+    }
+
+    return slots;
+}
+
+void tag_catalog::write(const std::string& path, std::span<const catalog_tag> tags) {
+    uint64_t size = tags.size();
+    uint64_t buckets = bucket_count(size);
+    uint64_t table_size = std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(size) / load_factor), size);
+
+    std::vector<uint64_t> hashes(size);
+    std::vector<uint32_t> pilots;
+    std::vector<uint32_t> remap;
+    std::optional<std::vector<uint32_t>> slots;
+
+    uint64_t seed = 0;
+    for (;; ++seed) {
+        if (seed == max_seeds) {
+            throw std::runtime_error { std::format("No perfect hash found for {} tags", size) };
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            hashes[i] = hash_name(tags[i].name, seed);
+        }
+
+        /* Names with the same hash can never be told apart, try another seed */
+        std::vector<uint32_t> order(size);
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::sort(order, {}, [&](uint32_t i) { return hashes[i]; });
+
+        auto duplicate = std::ranges::adjacent_find(order, {}, [&](uint32_t i) { return hashes[i]; });
+        if (duplicate != order.end()) {
+            if (tags[*duplicate].name == tags[*(duplicate + 1)].name) {
+                throw std::invalid_argument { std::format("Tag {} is in the catalog twice", tags[*duplicate].name) };
+            }
+
+            continue;
+        }
+
+        if ((slots = place(hashes, seed, buckets, table_size, pilots, remap))) {
+            break;
+        }
+    }
+
+    std::vector<uint32_t> by_slot(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        by_slot[(*slots)[i]] = i;
+    }
+
+    std::vector<uint32_t> name_offsets { 0 };
+    std::vector<char> names;
+    std::vector<int32_t> ids;
+    std::vector<int32_t> post_counts;
+    std::vector<uint8_t> categories;
+
+    name_offsets.reserve(size + 1);
+    ids.reserve(size);
+    post_counts.reserve(size);
+    categories.reserve(size);
+
+    for (uint32_t i : by_slot) {
+        const catalog_tag& tag = tags[i];
+
+        names.insert(names.end(), tag.name.begin(), tag.name.end());
+        name_offsets.push_back(static_cast<uint32_t>(names.size()));
+        ids.push_back(tag.id);
+        post_counts.push_back(tag.post_count);
+        categories.push_back(tag.category);
+    }
+
+    snapshot_writer writer { path };
+    writer.write_value(catalog_header {
+        .magic = catalog_magic,
+        .version = catalog_version,
+        .size = static_cast<uint32_t>(size),
+        .seed = seed,
+        .table_size = table_size,
+    });
+
+    writer.write<uint32_t>(pilots);
+    writer.write<uint32_t>(remap);
+    writer.write<uint32_t>(name_offsets);
+    writer.write<char>(names);
+    writer.write<int32_t>(ids);
+    writer.write<int32_t>(post_counts);
+    writer.write<uint8_t>(categories);
+}
+
+std::optional<uint32_t> tag_catalog::find(std::string_view name) const {
+    if (_ids.empty()) {
+        return std::nullopt;
+    }
+
+    uint64_t hash = hash_name(name, _seed);
+    uint64_t position = position_of(hash, _pilots[bucket_of(hash, _pilots.size())], _seed, _table_size);
+    uint32_t slot = (position < size()) ? static_cast<uint32_t>(position) : _remap[position - size()];
+
+    if (this->name(slot) != name) {
+        return std::nullopt;
+    }
+
+    return slot;
+}
+
+std::string_view tag_catalog::name(uint32_t slot) const {
+    return { _names.data() + _name_offsets[slot], _name_offsets[slot + 1] - _name_offsets[slot] };
+}
+
+int32_t tag_catalog::id(uint32_t slot) const {
+    return _ids[slot];
+}
+
+int32_t tag_catalog::post_count(uint32_t slot) const {
+    return _post_counts[slot];
+}
+
+uint8_t tag_catalog::category(uint32_t slot) const {
+    return _categories[slot];
+}
+
+size_t tag_catalog::size() const {
+    return _ids.size();
+}
+
+memory_footprint tag_catalog::footprint() const {
+    return {
+        .mapped = _pilots.size_bytes() + _remap.size_bytes() + _name_offsets.size_bytes() + _names.size_bytes()
+            + _ids.size_bytes() + _post_counts.size_bytes() + _categories.size_bytes(),
+    };
+}
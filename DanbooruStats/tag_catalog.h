@@ -0,0 +1,70 @@
+#ifndef TAG_CATALOG_H
+#define TAG_CATALOG_H
+
+#include "mapped_file.h"
+#include "memory_footprint.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+/* A row of the tags table written by tools/fetch_tags */
+struct catalog_tag {
+    int32_t id;
+    std::string_view name;
+    int32_t post_count;
+    uint8_t category;
+};
+
+/* Every tag of the tags table, compiled by tools/compile_tags into a minimal perfect hash of the
+ * names plus dense arrays per slot. A name hashes to exactly one slot, so a lookup is a single
+ * comparison without allocating, and slots can be used as tag IDs.
+ *
+ * The hash follows PTHash: names are split into buckets, and every bucket gets the first pilot
+ * that sends all of its names to free slots of a table 1% larger than needed. Slots past the
+ * end are remapped into the holes left below it.
+ */
+class tag_catalog {
+    std::unique_ptr<mapped_file> _file;
+
+    uint64_t _seed = 0;
+    uint64_t _table_size = 0;
+
+    std::span<const uint32_t> _pilots;
+    std::span<const uint32_t> _remap;
+
+    /* Indexed by slot */
+    std::span<const uint32_t> _name_offsets;
+    std::span<const char> _names;
+    std::span<const int32_t> _ids;
+    std::span<const int32_t> _post_counts;
+    std::span<const uint8_t> _categories;
+
+    public:
+    /* Map a catalog written by write */
+    explicit tag_catalog(const std::string& path);
+
+    /* Compile tags (with unique names) into a catalog */
+    static void write(const std::string& path, std::span<const catalog_tag> tags);
+
+    /* Slot of a tag, if it's in the catalog */
+    [[nodiscard]] std::optional<uint32_t> find(std::string_view name) const;
+
+    [[nodiscard]] std::string_view name(uint32_t slot) const;
+
+    /* Danbooru's tag ID */
+    [[nodiscard]] int32_t id(uint32_t slot) const;
+    [[nodiscard]] int32_t post_count(uint32_t slot) const;
+
+    /* Same values as tag_type */
+    [[nodiscard]] uint8_t category(uint32_t slot) const;
+
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+};
+
+#endif /* TAG_CATALOG_H */
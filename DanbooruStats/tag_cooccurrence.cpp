@@ -0,0 +1,303 @@
+#include "tag_cooccurrence.h"
+
+#include "flat_hash_map.h"
+#include "thread_pool.h"
+#include "util.h"
+
+#include <magic_enum.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+
+using std::chrono::steady_clock;
+
+static constexpr size_t categories = magic_enum::enum_count<tag_type>();
+
+static constexpr auto by_rank = [](const tag_count& l, const tag_count& r) -> bool {
+    return (l.count != r.count) ? (l.count > r.count) : (l.tag < r.tag);
+};
+
+/* Written so it vectorizes, with independent sums to hide the latency of popcount */
+[[nodiscard]] static int32_t intersection_size(const uint64_t* a, const uint64_t* b, size_t words) {
+    uint64_t sums[4] {};
+
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        sums[0] += std::popcount(a[i + 0] & b[i + 0]);
+        sums[1] += std::popcount(a[i + 1] & b[i + 1]);
+        sums[2] += std::popcount(a[i + 2] & b[i + 2]);
+        sums[3] += std::popcount(a[i + 3] & b[i + 3]);
+    }
+
+    for (; i < words; ++i) {
+        sums[0] += std::popcount(a[i] & b[i]);
+    }
+
+    return static_cast<int32_t>(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+tag_cooccurrence::~tag_cooccurrence() {
+    /* The pool may still be referring to us */
+    if (_complete.valid()) {
+        _complete.wait();
+    }
+}
+
+void tag_cooccurrence::build(const post_table& posts, const posting_index& index, size_t budget, thread_pool& pool) {
+    wait();
+
+    _posts = &posts;
+    _index = &index;
+
+    auto promise = std::make_shared<std::promise<void>>();
+    _complete = promise->get_future().share();
+
+    pool.submit([this, budget, &pool, promise] {
+        try {
+            _build(budget, pool);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+std::vector<tag_count> tag_cooccurrence::related(tag_id tag, tag_type type) const {
+    wait();
+
+    if (!_index) {
+        return {};
+    }
+
+    size_t category = magic_enum::enum_index(type).value();
+
+    /* Tags created after building are never heavy */
+    if (uint32_t slot = (tag < _heavy_slots.size()) ? _heavy_slots[tag] : not_heavy; slot != not_heavy) {
+        auto first = _pairs.begin() + _pair_offsets[slot * categories + category];
+        auto last = _pairs.begin() + _pair_offsets[slot * categories + category + 1];
+        return { first, last };
+    }
+
+    const tag_column& column = _posts->tags(type);
+
+    flat_hash_map<tag_id, int32_t> counts;
+    (*_index)[tag].for_each([&](post_row row) {
+        for (tag_id other : column[row]) {
+            if (other != tag) {
+                counts[other] += 1;
+            }
+        }
+    });
+
+    std::vector<tag_count> res;
+    res.reserve(counts.size());
+    for (const auto& [other, count] : counts) {
+        res.push_back({ other, count });
+    }
+
+    std::ranges::sort(res, {}, &tag_count::tag);
+
+    return res;
+}
+
+bool tag_cooccurrence::pruned(tag_id tag) const {
+    wait();
+
+    return tag < _heavy_slots.size() && _heavy_slots[tag] != not_heavy;
+}
+
+memory_footprint tag_cooccurrence::footprint() const {
+    /* Nothing is there until it's built */
+    if (!_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready) {
+        return {};
+    }
+
+    memory_footprint res;
+    res.owned += _heavy_slots.capacity() * sizeof(uint32_t);
+    res.owned += _pair_offsets.capacity() * sizeof(uint32_t);
+    res.owned += _pairs.capacity() * sizeof(tag_count);
+
+    return res;
+}
+
+bool tag_cooccurrence::ready() const {
+    return !_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready;
+}
+
+void tag_cooccurrence::wait() const {
+    if (_complete.valid()) {
+        _complete.get();
+    }
+}
+
+void tag_cooccurrence::_build(size_t budget, thread_pool& pool) {
+    auto begin = steady_clock::now();
+
+    const post_table& posts = *_posts;
+    const posting_index& index = *_index;
+
+    size_t rows = index.rows();
+    size_t tags = index.tags();
+
+    std::vector<uint32_t> sizes(tags);
+    pool.parallel_for(tags, [&](size_t tag) {
+        sizes[tag] = static_cast<uint32_t>(index[static_cast<tag_id>(tag)].size());
+    }, 4096);
+
+    std::vector<uint8_t> tag_categories(tags);
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        uint8_t category = static_cast<uint8_t>(magic_enum::enum_index(type).value());
+        for (tag_id tag : posts.tags(type).values()) {
+            tag_categories[tag] = category;
+        }
+    }
+
+    /* Heavy tags are the largest ones, as many as fit in half the budget as bitsets */
+    size_t words = (rows + 63) / 64;
+
+    std::vector<tag_id> heavy;
+    for (tag_id tag = 0; tag < tags; ++tag) {
+        if (sizes[tag] >= min_heavy_posts) {
+            heavy.push_back(tag);
+        }
+    }
+
+    size_t heavy_count = std::min({ heavy.size(), max_heavy, (budget / 2) / std::max<size_t>(words * sizeof(uint64_t), 1) });
+
+    auto by_size = [&](tag_id l, tag_id r) {
+        return sizes[l] > sizes[r];
+    };
+
+    std::ranges::nth_element(heavy, heavy.begin() + heavy_count, by_size);
+    heavy.resize(heavy_count);
+
+    std::vector<uint32_t> heavy_slots(tags, not_heavy);
+    for (uint32_t slot = 0; slot < heavy_count; ++slot) {
+        heavy_slots[heavy[slot]] = slot;
+    }
+
+    std::vector<uint64_t> bitsets(heavy_count * words);
+    pool.parallel_for(heavy_count, [&](size_t slot) {
+        uint64_t* bits = bitsets.data() + (slot * words);
+        index[heavy[slot]].for_each([bits](post_row row) {
+            bits[row / 64] |= uint64_t { 1 } << (row % 64);
+        });
+    });
+
+    /* Every heavy pair, both ways around. Every task only writes the pairs of it's own slot. */
+    std::vector<int32_t> heavy_pairs(heavy_count * heavy_count);
+    pool.parallel_for(heavy_count, [&](size_t i) {
+        for (size_t j = i + 1; j < heavy_count; ++j) {
+            int32_t count = intersection_size(bitsets.data() + (i * words), bitsets.data() + (j * words), words);
+            heavy_pairs[i * heavy_count + j] = count;
+            heavy_pairs[j * heavy_count + i] = count;
+        }
+    });
+
+    bitsets = {};
+
+    /* Heavy tags seen on the posts of every tail tag, a tail tag with too few posts can't form a kept pair */
+    static constexpr size_t tail_batch = 4096;
+
+    struct tail_pair {
+        uint32_t slot;
+        tag_count pair;
+    };
+
+    std::vector<std::vector<tail_pair>> tail_pairs((tags + tail_batch - 1) / tail_batch);
+    pool.parallel_for(tail_pairs.size(), [&](size_t batch) {
+        std::vector<int32_t> counts(heavy_count);
+        std::vector<uint32_t> touched;
+
+        tag_id last = static_cast<tag_id>(std::min(tags, (batch + 1) * tail_batch));
+        for (tag_id tag = static_cast<tag_id>(batch * tail_batch); tag < last; ++tag) {
+            if (heavy_slots[tag] != not_heavy || sizes[tag] < static_cast<uint32_t>(min_pair_count)) {
+                continue;
+            }
+
+            index[tag].for_each([&](post_row row) {
+                for (tag_type type : magic_enum::enum_values<tag_type>()) {
+                    for (tag_id other : posts.tags(type)[row]) {
+                        uint32_t slot = heavy_slots[other];
+                        if (slot != not_heavy && counts[slot]++ == 0) {
+                            touched.push_back(slot);
+                        }
+                    }
+                }
+            });
+
+            for (uint32_t slot : touched) {
+                if (counts[slot] >= min_pair_count) {
+                    tail_pairs[batch].push_back({ slot, { tag, counts[slot] } });
+                }
+
+                counts[slot] = 0;
+            }
+
+            touched.clear();
+        }
+    });
+
+    /* Group the tail pairs by heavy tag */
+    std::vector<std::vector<tag_count>> candidates(heavy_count);
+    for (auto& batch : tail_pairs) {
+        for (const auto& [slot, pair] : batch) {
+            candidates[slot].push_back(pair);
+        }
+
+        batch = {};
+    }
+
+    /* The other half of the budget goes to the kept pairs */
+    size_t kept = std::min(kept_pairs, (budget / 2) / std::max<size_t>(heavy_count * categories * sizeof(tag_count), 1));
+
+    std::vector<std::vector<tag_count>> lists(heavy_count * categories);
+    pool.parallel_for(heavy_count, [&](size_t slot) {
+        std::vector<tag_count>& pairs = candidates[slot];
+        for (size_t other = 0; other < heavy_count; ++other) {
+            int32_t count = heavy_pairs[slot * heavy_count + other];
+            if (other != slot && count >= min_pair_count) {
+                pairs.push_back({ heavy[other], count });
+            }
+        }
+
+        for (const tag_count& pair : pairs) {
+            lists[slot * categories + tag_categories[pair.tag]].push_back(pair);
+        }
+
+        pairs = {};
+
+        for (size_t category = 0; category < categories; ++category) {
+            std::vector<tag_count>& list = lists[slot * categories + category];
+            if (list.size() > kept) {
+                std::ranges::nth_element(list, list.begin() + kept, by_rank);
+                list.resize(kept);
+                list.shrink_to_fit();
+            }
+
+            std::ranges::sort(list, {}, &tag_count::tag);
+        }
+    });
+
+    std::vector<uint32_t> pair_offsets(lists.size() + 1);
+    for (size_t i = 0; i < lists.size(); ++i) {
+        pair_offsets[i + 1] = pair_offsets[i] + static_cast<uint32_t>(lists[i].size());
+    }
+
+    std::vector<tag_count> pairs;
+    pairs.reserve(pair_offsets.back());
+    for (const auto& list : lists) {
+        pairs.insert(pairs.end(), list.begin(), list.end());
+    }
+
+    /* Nobody looks at these until we're done */
+    _heavy_slots = std::move(heavy_slots);
+    _pair_offsets = std::move(pair_offsets);
+    _pairs = std::move(pairs);
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Counted co-occurrence of {} tags ({} heavy, {} pairs kept) in {}", tags, heavy_count, _pairs.size(), end - begin);
+}
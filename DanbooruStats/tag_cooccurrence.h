@@ -0,0 +1,81 @@
+#ifndef TAG_COOCCURRENCE_H
+#define TAG_COOCCURRENCE_H
+
+#include "post_table.h"
+#include "posting_index.h"
+#include "tag_ranking.h"
+
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <span>
+#include <vector>
+
+class thread_pool;
+
+/* How often tags appear on the same posts, for the tags related to any tag.
+ * Built on the pool from the posting_index. Pairs of a heavy tag, one of the few
+ * largest, are counted up front: heavy pairs by intersecting bitsets of their posts, heavy and
+ * long tail pairs from the posts of the tail tags. Rare pairs are pruned from these and only the
+ * top of every category is kept. Tail tags have few posts, so their pairs are counted on demand.
+ */
+class tag_cooccurrence {
+    public:
+    /* Bitsets only pay off for the largest tags, and the heavy pairs grow quadratically */
+    static constexpr size_t max_heavy = 512;
+    static constexpr size_t min_heavy_posts = 1024;
+
+    /* Pairs seen less often are pruned from the precalculated lists */
+    static constexpr int32_t min_pair_count = 2;
+
+    /* At most this many pairs are kept per heavy tag and category */
+    static constexpr size_t kept_pairs = 256;
+
+    private:
+    static constexpr uint32_t not_heavy = std::numeric_limits<uint32_t>::max();
+
+    const post_table* _posts = nullptr;
+    const posting_index* _index = nullptr;
+
+    /* Slot of every heavy tag, indexed by tag ID */
+    std::vector<uint32_t> _heavy_slots;
+
+    /* Precalculated pairs sorted by tag, those of slot s and category c start at _pair_offsets[s * categories + c] */
+    std::vector<uint32_t> _pair_offsets;
+    std::vector<tag_count> _pairs;
+
+    std::shared_future<void> _complete;
+
+    public:
+    tag_cooccurrence() = default;
+    ~tag_cooccurrence();
+
+    tag_cooccurrence(const tag_cooccurrence&) = delete;
+    tag_cooccurrence& operator=(const tag_cooccurrence&) = delete;
+
+    /* Count pairs over the posts and their index (which must outlive this) in the background.
+     * budget bounds the bitsets and the kept pairs.
+     */
+    void build(const post_table& posts, const posting_index& index, size_t budget, thread_pool& pool);
+
+    /* Tags of a category seen together with tag and on how many posts, sorted by tag.
+     * Complete for tail tags, pruned and as built for heavy tags.
+     */
+    [[nodiscard]] std::vector<tag_count> related(tag_id tag, tag_type type) const;
+
+    /* Whether the related tags of tag are pruned, they're complete otherwise */
+    [[nodiscard]] bool pruned(tag_id tag) const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    /* Whether building is done, without waiting */
+    [[nodiscard]] bool ready() const;
+
+    /* Wait until building is done */
+    void wait() const;
+
+    private:
+    void _build(size_t budget, thread_pool& pool);
+};
+
+#endif /* TAG_COOCCURRENCE_H */
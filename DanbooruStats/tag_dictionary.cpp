@@ -0,0 +1,125 @@
+#include "tag_dictionary.h"
+
+#include "snapshot.h"
+#include "tag_catalog.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+tag_id tag_dictionary::intern(std::string_view name) {
+    if (auto id = find(name)) {
+        return *id;
+    }
+
+    tag_id id = static_cast<tag_id>(size());
+    std::string_view stored = _names.emplace_back(_arena.store(name));
+    _ids.emplace(stored, id);
+
+    return id;
+}
+
+std::optional<tag_id> tag_dictionary::find(std::string_view name) const {
+    /* Nearly every tag is in the catalog */
+    if (_catalog) {
+        if (auto slot = _catalog->find(name)) {
+            return *slot;
+        }
+    }
+
+    if (auto it = _ids.find(name); it != _ids.end()) {
+        return it->second;
+    }
+
+    if (_mapped_count > 0 && !_catalog) {
+        auto it = std::ranges::lower_bound(_mapped_order, name, {}, [this](tag_id id) { return this->name(id); });
+        if (it != _mapped_order.end() && this->name(*it) == name) {
+            return *it;
+        }
+    }
+
+    return {};
+}
+
+std::string_view tag_dictionary::name(tag_id id) const {
+    if (id < _mapped_count) {
+        if (_catalog) {
+            return _catalog->name(id);
+        }
+
+        return { _mapped_names.data() + _mapped_offsets[id], _mapped_offsets[id + 1] - _mapped_offsets[id] };
+    }
+
+    return _names.at(id - _mapped_count);
+}
+
+size_t tag_dictionary::size() const {
+    return _mapped_count + _names.size();
+}
+
+const tag_catalog* tag_dictionary::catalog() const {
+    return _catalog;
+}
+
+memory_footprint tag_dictionary::footprint() const {
+    return {
+        .owned = _ids.memory_usage() + _arena.memory_usage() + (_names.capacity() * sizeof(std::string_view)),
+        .mapped = _mapped_offsets.size_bytes() + _mapped_names.size_bytes() + _mapped_order.size_bytes() + (_catalog ? _catalog->footprint().mapped : 0),
+    };
+}
+
+void tag_dictionary::write(snapshot_writer& writer) const {
+    std::vector<uint32_t> offsets;
+    offsets.reserve(size() + 1);
+    offsets.push_back(0);
+
+    std::vector<char> names;
+    for (tag_id id = 0; id < size(); ++id) {
+        std::string_view name = this->name(id);
+        names.insert(names.end(), name.begin(), name.end());
+        offsets.push_back(static_cast<uint32_t>(names.size()));
+    }
+
+    std::vector<tag_id> order(size());
+    std::iota(order.begin(), order.end(), tag_id { 0 });
+    std::ranges::sort(order, {}, [this](tag_id id) { return name(id); });
+
+    writer.write<uint32_t>(offsets);
+    writer.write<char>(names);
+    writer.write<tag_id>(order);
+}
+
+void tag_dictionary::read(snapshot_reader& reader) {
+    if (size() != 0) {
+        throw std::logic_error { "Snapshots can only be read into an empty tag dictionary" };
+    }
+
+    _mapped_offsets = reader.read<uint32_t>();
+    _mapped_names = reader.read<char>();
+    _mapped_order = reader.read<tag_id>();
+
+    if (_mapped_offsets.empty() || _mapped_order.size() != _mapped_offsets.size() - 1) {
+        throw std::runtime_error { "Corrupt tag dictionary in snapshot" };
+    }
+
+    /* name() and find() index with these unchecked */
+    if (_mapped_offsets.front() != 0 || _mapped_offsets.back() > _mapped_names.size() || !std::ranges::is_sorted(_mapped_offsets)) {
+        throw std::runtime_error { "Corrupt tag names in snapshot" };
+    }
+
+    if (std::ranges::any_of(_mapped_order, [this](tag_id id) { return id >= _mapped_order.size(); })) {
+        throw std::runtime_error { "Corrupt tag order in snapshot" };
+    }
+
+    _mapped_count = static_cast<tag_id>(_mapped_order.size());
+}
+
+void tag_dictionary::attach(const tag_catalog& catalog) {
+    if (size() != 0) {
+        throw std::logic_error { "A catalog can only be attached to an empty tag dictionary" };
+    }
+
+    _catalog = &catalog;
+    _mapped_count = static_cast<tag_id>(catalog.size());
+}
@@ -0,0 +1,63 @@
+#ifndef TAG_DICTIONARY_H
+#define TAG_DICTIONARY_H
+
+#include "flat_hash_map.h"
+#include "memory_footprint.h"
+#include "string_arena.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using tag_id = uint32_t;
+
+class snapshot_reader;
+class snapshot_writer;
+class tag_catalog;
+
+/* Interned tag names, IDs are dense and assigned in order of first occurence */
+class tag_dictionary {
+    /* Tags read from a snapshot, stored back to back with IDs sorted by name for lookups */
+    std::span<const uint32_t> _mapped_offsets;
+    std::span<const char> _mapped_names;
+    std::span<const tag_id> _mapped_order;
+    tag_id _mapped_count = 0;
+
+    /* Takes the place of the mapped tags when attached */
+    const tag_catalog* _catalog = nullptr;
+
+    /* Tags added at runtime, after the mapped ones.
+     * Names never move in the arena, so the keys in _ids stay valid.
+     */
+    string_arena _arena;
+    std::vector<std::string_view> _names;
+    flat_hash_map<std::string_view, tag_id> _ids;
+
+    public:
+    /* Return the ID for the given name, inserting it if it's not present yet */
+    [[nodiscard]] tag_id intern(std::string_view name);
+
+    [[nodiscard]] std::optional<tag_id> find(std::string_view name) const;
+    [[nodiscard]] std::string_view name(tag_id id) const;
+    [[nodiscard]] size_t size() const;
+
+    /* The catalog the first IDs are slots of, if any */
+    [[nodiscard]] const tag_catalog* catalog() const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    void write(snapshot_writer& writer) const;
+
+    /* Refer to the tags in a mapped snapshot, only valid on an empty dictionary */
+    void read(snapshot_reader& reader);
+
+    /* Use the slots of a catalog as the first IDs, only valid on an empty dictionary.
+     * The catalog must outlive the dictionary.
+     */
+    void attach(const tag_catalog& catalog);
+};
+
+#endif /* TAG_DICTIONARY_H */
@@ -0,0 +1,45 @@
+#include "tag_query.h"
+
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+tag_query tag_query::parse(std::string_view query) {
+    static constexpr std::string_view whitespace = " \t\r\n";
+    static constexpr std::string_view user_prefix = "user:";
+
+    tag_query res;
+
+    for (size_t pos = query.find_first_not_of(whitespace); pos != std::string_view::npos; pos = query.find_first_not_of(whitespace, pos)) {
+        size_t end = query.find_first_of(whitespace, pos);
+        std::string_view term = query.substr(pos, end - pos);
+        pos = end;
+
+        if (term.starts_with(user_prefix)) {
+            std::string_view id = term.substr(user_prefix.size());
+
+            int32_t user_id;
+            auto [ptr, ec] = std::from_chars(id.data(), id.data() + id.size(), user_id);
+            if (ec != std::errc {} || ptr != id.data() + id.size()) {
+                throw std::invalid_argument { std::format("invalid user in {}", term) };
+            }
+
+            res.users.push_back(user_id);
+        } else if (term.starts_with('-') || term.starts_with('~')) {
+            if (term.size() == 1) {
+                throw std::invalid_argument { std::format("missing tag after {}", term) };
+            }
+
+            (term.front() == '-' ? res.excluded : res.any).emplace_back(term.substr(1));
+        } else {
+            res.required.emplace_back(term);
+        }
+    }
+
+    /* Counting the tags of every post takes seconds */
+    if (res.required.empty() && res.any.empty() && res.users.empty()) {
+        throw std::invalid_argument { "at least one tag, ~tag or user: is required" };
+    }
+
+    return res;
+}
@@ -0,0 +1,46 @@
+#ifndef TAG_QUERY_H
+#define TAG_QUERY_H
+
+#include "post_table.h"
+#include "tag_ranking.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* A Danbooru-style tag search: "tag1 tag2 -tag3 ~tag4 ~tag5 user:123".
+ * Matches posts with all plain tags, at least one of the ~ tags, none of the - tags and
+ * uploaded by the given user. At least one plain tag, ~ tag or user is required, so a
+ * search never starts from all posts.
+ */
+struct tag_query {
+    std::vector<std::string> required;
+    std::vector<std::string> any;
+    std::vector<std::string> excluded;
+    std::vector<int32_t> users;
+
+    /* Throws std::invalid_argument on malformed terms, or without any plain tag, ~ tag or user */
+    [[nodiscard]] static tag_query parse(std::string_view query);
+};
+
+struct user_count {
+    int32_t user_id;
+    int32_t posts;
+};
+
+/* Posts matching a tag_query, and what's on them */
+struct search_result {
+    size_t posts = 0;
+
+    /* IDs of the first matching posts */
+    std::vector<int32_t> post_ids;
+
+    /* Sorted by user ID */
+    std::vector<user_count> users;
+
+    /* Sorted by tag ID */
+    tag_type_array<std::vector<tag_count>> tag_counts;
+};
+
+#endif /* TAG_QUERY_H */
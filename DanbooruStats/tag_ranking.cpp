@@ -0,0 +1,186 @@
+#include "tag_ranking.h"
+
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+
+using std::chrono::steady_clock;
+
+/* Ties are ordered by ID, so rankings don't depend on the order they're calculated in */
+static constexpr auto by_rank = [](const tag_count& l, const tag_count& r) -> bool {
+    return (l.count != r.count) ? (l.count > r.count) : (l.tag < r.tag);
+};
+
+tag_ranking::~tag_ranking() {
+    /* The pool may still be referring to us */
+    if (_complete.valid()) {
+        _complete.wait();
+    }
+}
+
+void tag_ranking::build(std::span<const tag_count> counts, size_t tags, thread_pool& pool) {
+    wait();
+
+    std::vector<tag_count> order { counts.begin(), counts.end() };
+    _top = std::min(top_size, order.size());
+
+    /* Select and order only the top now, instead of sorting everything */
+    std::ranges::nth_element(order, order.begin() + _top, by_rank);
+    std::sort(order.begin(), order.begin() + _top, by_rank);
+
+    _order = std::move(order);
+    _complete_async(pool, tags);
+}
+
+size_t tag_ranking::size() const {
+    return _order.size();
+}
+
+std::span<const tag_count> tag_ranking::page(size_t offset, size_t limit) const {
+    if (offset >= _order.size()) {
+        return {};
+    }
+
+    limit = std::min(limit, _order.size() - offset);
+    if (offset + limit > _top) {
+        wait();
+    }
+
+    return _order.span().subspan(offset, limit);
+}
+
+std::optional<uint32_t> tag_ranking::rank(tag_id tag) const {
+    wait();
+
+    if (tag >= _ranks.size() || _ranks[tag] == no_rank) {
+        return std::nullopt;
+    }
+
+    return _ranks[tag];
+}
+
+void tag_ranking::update(tag_id tag, int32_t count) {
+    wait();
+
+    if (tag >= _ranks.size()) {
+        _ranks.resize(tag + 1, no_rank);
+    }
+
+    std::vector<tag_count>& order = _order.mutate();
+
+    if (_ranks[tag] == no_rank) {
+        if (count <= 0) {
+            return;
+        }
+
+        _ranks[tag] = static_cast<uint32_t>(order.size());
+        order.push_back({ tag, 0 });
+    }
+
+    auto swap_entries = [&](size_t a, size_t b) {
+        std::swap(order[a], order[b]);
+        _ranks[order[a].tag] = static_cast<uint32_t>(a);
+        _ranks[order[b].tag] = static_cast<uint32_t>(b);
+    };
+
+    /* Instead of shifting every tag in between, swap places with the outermost tag of every
+     * run of equal counts we pass, so this costs a binary search per distinct count passed.
+     * Ties don't keep their order by ID here.
+     */
+    size_t pos = _ranks[tag];
+    while (pos > 0 && order[pos - 1].count < count) {
+        auto first = std::ranges::lower_bound(order.begin(), order.begin() + pos, order[pos - 1].count, std::greater {}, &tag_count::count);
+        size_t dst = static_cast<size_t>(first - order.begin());
+
+        swap_entries(dst, pos);
+        pos = dst;
+    }
+
+    while (pos + 1 < order.size() && order[pos + 1].count > count) {
+        auto last = std::ranges::upper_bound(order.begin() + pos + 1, order.end(), order[pos + 1].count, std::greater {}, &tag_count::count);
+        size_t dst = static_cast<size_t>(last - order.begin()) - 1;
+
+        swap_entries(dst, pos);
+        pos = dst;
+    }
+
+    order[pos].count = count;
+
+    /* Nothing else has a count of 0, so it ended up last */
+    if (count <= 0) {
+        order.pop_back();
+        _ranks[tag] = no_rank;
+    }
+
+    _top = order.size();
+}
+
+memory_footprint tag_ranking::footprint() const {
+    /* Neither is resized while completing */
+    memory_footprint res = _order.footprint();
+    res.owned += _ranks.capacity() * sizeof(uint32_t);
+
+    return res;
+}
+
+bool tag_ranking::ready() const {
+    return !_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready;
+}
+
+void tag_ranking::wait() const {
+    if (_complete.valid()) {
+        _complete.get();
+    }
+}
+
+void tag_ranking::write(snapshot_writer& writer) const {
+    wait();
+
+    writer.write<tag_count>(_order);
+}
+
+void tag_ranking::read(snapshot_reader& reader, size_t tags, thread_pool& pool) {
+    wait();
+
+    _order = cow_array { reader.read<tag_count>() };
+    _top = _order.size();
+
+    /* Already ordered, only the positions are left */
+    _complete_async(pool, tags);
+}
+
+void tag_ranking::_complete_async(thread_pool& pool, size_t tags) {
+    auto promise = std::make_shared<std::promise<void>>();
+    _complete = promise->get_future().share();
+
+    _ranks.assign(tags, no_rank);
+
+    pool.submit([this, promise] {
+        try {
+            auto begin = steady_clock::now();
+
+            if (_top < _order.size()) {
+                /* Owned after build, and nobody reads beyond _top until we're done */
+                std::vector<tag_count>& order = _order.mutate();
+                std::sort(order.begin() + _top, order.end(), by_rank);
+            }
+
+            for (size_t i = 0; i < _order.size(); ++i) {
+                _ranks[_order[i].tag] = static_cast<uint32_t>(i);
+            }
+
+            auto end = steady_clock::now();
+
+            spdlog::debug("Completed ranking of {} tags in {}", _order.size(), end - begin);
+
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
@@ -0,0 +1,84 @@
+#ifndef TAG_RANKING_H
+#define TAG_RANKING_H
+
+#include "cow_array.h"
+#include "tag_dictionary.h"
+
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+class snapshot_reader;
+class snapshot_writer;
+class thread_pool;
+
+/* Plain struct instead of a pair so arrays of it can be used in place from a snapshot */
+struct tag_count {
+    tag_id tag;
+    int32_t count;
+};
+
+/* Tags ordered by count descending, with the position of every tag.
+ * Only the top is ordered up front, the rest of the order and the positions are finished on
+ * a thread pool. Anything beyond the top waits for that, after which every lookup is O(1).
+ */
+class tag_ranking {
+    public:
+    /* Enough for the first pages of every category */
+    static constexpr size_t top_size = 4096;
+
+    private:
+    static constexpr uint32_t no_rank = std::numeric_limits<uint32_t>::max();
+
+    cow_array<tag_count> _order;
+
+    /* Position in _order, indexed by tag ID */
+    std::vector<uint32_t> _ranks;
+
+    /* Length of the prefix of _order that's usable before _complete */
+    size_t _top = 0;
+    std::shared_future<void> _complete;
+
+    public:
+    tag_ranking() = default;
+    ~tag_ranking();
+
+    tag_ranking(const tag_ranking&) = delete;
+    tag_ranking& operator=(const tag_ranking&) = delete;
+
+    /* Rank counts (sorted by tag) of a dictionary with tags tags */
+    void build(std::span<const tag_count> counts, size_t tags, thread_pool& pool);
+
+    [[nodiscard]] size_t size() const;
+
+    /* Up to limit tags starting at offset */
+    [[nodiscard]] std::span<const tag_count> page(size_t offset, size_t limit) const;
+
+    /* 0-based position of a tag, if it's ranked */
+    [[nodiscard]] std::optional<uint32_t> rank(tag_id tag) const;
+
+    /* Move a tag to it's new count, which removes it at 0 */
+    void update(tag_id tag, int32_t count);
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    /* Whether the full order is available, without waiting */
+    [[nodiscard]] bool ready() const;
+
+    /* Wait until the full order is available */
+    void wait() const;
+
+    void write(snapshot_writer& writer) const;
+
+    /* Refer to the (fully ordered) ranking in a mapped snapshot */
+    void read(snapshot_reader& reader, size_t tags, thread_pool& pool);
+
+    private:
+    /* Order everything after _top and index all positions on the pool */
+    void _complete_async(thread_pool& pool, size_t tags);
+};
+
+#endif /* TAG_RANKING_H */
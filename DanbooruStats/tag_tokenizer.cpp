@@ -0,0 +1,147 @@
+#include "tag_tokenizer.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TOKENIZER_X86 1
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+/* MSVC allows any intrinsic anywhere */
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define TOKENIZER_X86 0
+#endif
+
+/* Tags between the spaces set in mask, for the block starting at base. start is where the current tag started. */
+static inline void emit_tags(std::string_view str, size_t base, uint32_t mask, size_t& start, std::vector<std::string_view>& out) {
+    while (mask != 0) {
+        size_t space = base + std::countr_zero(mask);
+        if (space > start) {
+            out.push_back(str.substr(start, space - start));
+        }
+
+        start = space + 1;
+        mask &= mask - 1;
+    }
+}
+
+/* Whatever's left after the last full block */
+static inline void split_tail(std::string_view str, size_t pos, size_t start, std::vector<std::string_view>& out) {
+    for (; pos < str.size(); ++pos) {
+        if (str[pos] == ' ') {
+            if (pos > start) {
+                out.push_back(str.substr(start, pos - start));
+            }
+
+            start = pos + 1;
+        }
+    }
+
+    if (str.size() > start) {
+        out.push_back(str.substr(start));
+    }
+}
+
+static void split_scalar(std::string_view str, std::vector<std::string_view>& out) {
+    size_t start = 0;
+    while (start < str.size()) {
+        auto space = static_cast<const char*>(std::memchr(str.data() + start, ' ', str.size() - start));
+        size_t end = space ? static_cast<size_t>(space - str.data()) : str.size();
+
+        if (end > start) {
+            out.push_back(str.substr(start, end - start));
+        }
+
+        start = end + 1;
+    }
+}
+
+#if TOKENIZER_X86
+static void split_sse2(std::string_view str, std::vector<std::string_view>& out) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+
+    size_t start = 0;
+    size_t pos = 0;
+    for (; pos + 16 <= str.size(); pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces)));
+
+        emit_tags(str, pos, mask, start, out);
+    }
+
+    split_tail(str, pos, start, out);
+}
+
+TARGET_AVX2 static void split_avx2(std::string_view str, std::vector<std::string_view>& out) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+
+    size_t start = 0;
+    size_t pos = 0;
+    for (; pos + 32 <= str.size(); pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str.data() + pos));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, spaces)));
+
+        emit_tags(str, pos, mask, start, out);
+    }
+
+    split_tail(str, pos, start, out);
+}
+
+[[nodiscard]] static bool has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    /* The OS has to save the AVX registers too */
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+tokenizer_impl best_tokenizer_impl() {
+#if TOKENIZER_X86
+    /* SSE2 is part of x86-64 */
+    static const tokenizer_impl best = has_avx2() ? tokenizer_impl::avx2 : tokenizer_impl::sse2;
+    return best;
+#else
+    return tokenizer_impl::scalar;
+#endif
+}
+
+tag_tokenizer::tag_tokenizer(tokenizer_impl impl) {
+    switch (impl) {
+#if TOKENIZER_X86
+        case tokenizer_impl::sse2: _split = split_sse2; break;
+        case tokenizer_impl::avx2: _split = split_avx2; break;
+#endif
+        default: _split = split_scalar; break;
+    }
+}
+
+std::span<const std::string_view> tag_tokenizer::split(std::string_view tag_string) {
+    _tags.clear();
+    _split(tag_string, _tags);
+
+    return _tags;
+}
@@ -0,0 +1,34 @@
+#ifndef TAG_TOKENIZER_H
+#define TAG_TOKENIZER_H
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+/* Implementations of the delimiter search, the best one is picked at runtime */
+enum class tokenizer_impl {
+    scalar,
+    sse2,
+    avx2,
+};
+
+/* Fastest implementation supported by this CPU */
+[[nodiscard]] tokenizer_impl best_tokenizer_impl();
+
+/* Splits space-separated tag strings, skipping empty tags. Finds spaces 16 or 32 bytes at a time. */
+class tag_tokenizer {
+    using split_function = void (*)(std::string_view, std::vector<std::string_view>&);
+
+    split_function _split;
+
+    /* Reused between calls */
+    std::vector<std::string_view> _tags;
+
+    public:
+    explicit tag_tokenizer(tokenizer_impl impl = best_tokenizer_impl());
+
+    /* Tags of tag_string, valid until the next call and as long as tag_string */
+    [[nodiscard]] std::span<const std::string_view> split(std::string_view tag_string);
+};
+
+#endif /* TAG_TOKENIZER_H */
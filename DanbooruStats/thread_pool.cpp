@@ -0,0 +1,116 @@
+#include "thread_pool.h"
+
+/* Worker index of the current thread within the pool that owns it */
+static thread_local const thread_pool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+thread_pool::thread_pool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    _queues.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        _queues.push_back(std::make_unique<worker_queue>());
+    }
+
+    _threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back(&thread_pool::_worker, this, i);
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::scoped_lock lock { _sleep_lock };
+        _stopping = true;
+    }
+
+    _wake.notify_all();
+
+    /* jthread joins on destruction, but the queues must outlive the workers */
+    _threads.clear();
+}
+
+size_t thread_pool::size() const {
+    return _queues.size();
+}
+
+void thread_pool::submit(task task) {
+    size_t index = (current_pool == this)
+        ? current_worker
+        : _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+
+    /* Counted before it's visible, or a worker taking it right away could take _pending below zero.
+     * A worker seeing the count first just looks again until the task is there.
+     */
+    _pending.fetch_add(1, std::memory_order_release);
+
+    {
+        worker_queue& queue = *_queues[index];
+        std::scoped_lock lock { queue.lock };
+        queue.tasks.push_back(std::move(task));
+    }
+
+    /* Take the lock so a worker can't miss the wakeup between checking and waiting */
+    {
+        std::scoped_lock lock { _sleep_lock };
+    }
+
+    _wake.notify_one();
+}
+
+void thread_pool::_worker(size_t index) {
+    current_pool = this;
+    current_worker = index;
+
+    for (;;) {
+        if (_run_one()) {
+            continue;
+        }
+
+        std::unique_lock lock { _sleep_lock };
+        _wake.wait(lock, [this] {
+            return _stopping || _pending.load(std::memory_order_acquire) > 0;
+        });
+
+        if (_stopping && _pending.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+bool thread_pool::_run_one() {
+    size_t self = (current_pool == this) ? current_worker : 0;
+
+    task task;
+
+    /* Newest task from our own queue first, it's most likely to still be in cache */
+    {
+        worker_queue& queue = *_queues[self];
+        std::scoped_lock lock { queue.lock };
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    /* Otherwise steal the oldest task of another worker */
+    for (size_t i = 1; !task && i < _queues.size(); ++i) {
+        worker_queue& queue = *_queues[(self + i) % _queues.size()];
+        std::scoped_lock lock { queue.lock };
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    _pending.fetch_sub(1, std::memory_order_acq_rel);
+    task();
+
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing thread pool. Every worker owns a queue, takes the newest task from it's own
+ * queue and steals the oldest task from the other queues when it runs dry.
+ */
+class thread_pool {
+    public:
+    using task = std::function<void()>;
+
+    private:
+    struct worker_queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> _queues;
+    std::vector<std::jthread> _threads;
+
+    /* Tasks queued but not yet started */
+    std::atomic<size_t> _pending { 0 };
+    std::atomic<size_t> _next_queue { 0 };
+
+    std::mutex _sleep_lock;
+    std::condition_variable _wake;
+    bool _stopping = false;
+
+    public:
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /* 0 threads uses all hardware threads */
+    explicit thread_pool(size_t threads = 0);
+    ~thread_pool();
+
+    [[nodiscard]] size_t size() const;
+
+    /* Queue a task. Tasks submitted from a worker go to that worker's own queue */
+    void submit(task task);
+
+    /* Call body(i) for every i in [0, count) in batches of grain, and wait until all are done.
+     * The calling thread runs tasks while waiting, so this may be nested inside a task.
+     * The first exception thrown by body is rethrown.
+     */
+    template <typename F>
+    void parallel_for(size_t count, F&& body, size_t grain = 1);
+
+    private:
+    void _worker(size_t index);
+
+    /* Run a single queued task, returns false if none were found */
+    bool _run_one();
+};
+
+template <typename F>
+void thread_pool::parallel_for(size_t count, F&& body, size_t grain) {
+    if (count == 0) {
+        return;
+    }
+
+    grain = std::max<size_t>(grain, 1);
+    size_t batches = (count + grain - 1) / grain;
+
+    std::atomic<size_t> remaining { batches };
+    std::mutex error_lock;
+    std::exception_ptr error;
+
+    for (size_t batch = 0; batch < batches; ++batch) {
+        submit([&, batch] {
+            try {
+                size_t end = std::min(count, (batch + 1) * grain);
+                for (size_t i = batch * grain; i < end; ++i) {
+                    body(i);
+                }
+            } catch (...) {
+                std::scoped_lock lock { error_lock };
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    /* Help out instead of blocking, our own tasks are found first */
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!_run_one()) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif /* THREAD_POOL_H */
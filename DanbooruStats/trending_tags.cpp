@@ -0,0 +1,240 @@
+#include "trending_tags.h"
+
+#include <algorithm>
+
+using std::chrono::system_clock;
+
+space_saving::space_saving(size_t capacity) : _capacity { capacity } {
+
+}
+
+void space_saving::add(std::string_view key) {
+    if (auto it = _positions.find(key); it != _positions.end()) {
+        uint32_t index = it->second;
+        _heap[index].count += 1;
+        _sift_down(index);
+        return;
+    }
+
+    if (_heap.size() < _capacity) {
+        _heap.push_back(trending_tag { .name = std::string { key }, .count = 1, .error = 0 });
+        _positions.emplace(_heap.back().name, static_cast<uint32_t>(_heap.size() - 1));
+        _sift_up(static_cast<uint32_t>(_heap.size() - 1));
+        return;
+    }
+
+    /* Replace the least frequent key, which may have been this one all along */
+    trending_tag& min = _heap.front();
+    _positions.erase(min.name);
+
+    min.name = key;
+    min.error = min.count;
+    min.count += 1;
+
+    _positions.emplace(min.name, 0);
+    _sift_down(0);
+}
+
+void space_saving::clear() {
+    _heap.clear();
+    _positions.clear();
+}
+
+uint32_t space_saving::floor() const {
+    return (_heap.size() < _capacity) ? 0 : _heap.front().count;
+}
+
+std::span<const trending_tag> space_saving::counters() const {
+    return _heap;
+}
+
+size_t space_saving::memory_usage() const {
+    size_t res = (_heap.capacity() * sizeof(trending_tag)) + _positions.memory_usage();
+    for (const trending_tag& tag : _heap) {
+        /* Both copies may be on the heap */
+        res += 2 * tag.name.capacity();
+    }
+
+    return res;
+}
+
+void space_saving::_swap(uint32_t a, uint32_t b) {
+    std::swap(_heap[a], _heap[b]);
+    _positions.at(_heap[a].name) = a;
+    _positions.at(_heap[b].name) = b;
+}
+
+void space_saving::_sift_up(uint32_t index) {
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (_heap[parent].count <= _heap[index].count) {
+            break;
+        }
+
+        _swap(parent, index);
+        index = parent;
+    }
+}
+
+void space_saving::_sift_down(uint32_t index) {
+    for (;;) {
+        uint32_t smallest = index;
+        for (uint32_t child : { (2 * index) + 1, (2 * index) + 2 }) {
+            if (child < _heap.size() && _heap[child].count < _heap[smallest].count) {
+                smallest = child;
+            }
+        }
+
+        if (smallest == index) {
+            break;
+        }
+
+        _swap(smallest, index);
+        index = smallest;
+    }
+}
+
+/* Bucket width and buckets per window */
+static std::pair<std::chrono::seconds, size_t> window_layout(trend_window window) {
+    using enum trend_window;
+    switch (window) {
+        case hour: return { std::chrono::minutes { 5 }, 12 };
+        case day:  return { std::chrono::hours { 1 }, 24 };
+        case week: return { std::chrono::hours { 6 }, 28 };
+    }
+
+    return {};
+}
+
+static int64_t bucket_number(system_clock::time_point time, std::chrono::seconds width) {
+    return std::chrono::floor<std::chrono::seconds>(time.time_since_epoch()) / width;
+}
+
+trending_tags::trending_tags(size_t capacity) {
+    for (trend_window type : magic_enum::enum_values<trend_window>()) {
+        auto [width, buckets] = window_layout(type);
+
+        _windows[type].width = width;
+        _windows[type].buckets.assign(buckets, bucket { .summary = space_saving { capacity } });
+    }
+}
+
+void trending_tags::add(std::span<const post_version> versions) {
+    std::scoped_lock lock { _lock };
+
+    auto now = system_clock::now();
+
+    for (window& window : _windows) {
+        int64_t current = bucket_number(now, window.width);
+        int64_t buckets = static_cast<int64_t>(window.buckets.size());
+
+        for (const post_version& version : versions) {
+            if (version.id <= _last_id || version.added_tags.empty()) {
+                continue;
+            }
+
+            /* Anything from the future is happening now */
+            int64_t number = std::min(bucket_number(version.updated_at, window.width), current);
+            if (number <= current - buckets) {
+                continue;
+            }
+
+            bucket& bucket = window.buckets[number % buckets];
+            if (bucket.number != number) {
+                bucket.number = number;
+                bucket.summary.clear();
+            }
+
+            for (const std::string& tag : version.added_tags) {
+                bucket.summary.add(tag);
+            }
+
+            window.merged_number = -1;
+        }
+    }
+
+    if (!versions.empty()) {
+        _last_id = std::max(_last_id, versions.back().id);
+    }
+}
+
+std::vector<trending_tag> trending_tags::top(trend_window type, size_t limit) const {
+    std::scoped_lock lock { _lock };
+
+    window& window = _windows[type];
+
+    int64_t current = bucket_number(system_clock::now(), window.width);
+    if (window.merged_number != current) {
+        int64_t buckets = static_cast<int64_t>(window.buckets.size());
+
+        /* A tag missing from a full bucket may have been seen up to that bucket's floor times,
+         * counting that as error keeps count an upper bound and count - error a lower bound.
+         */
+        struct sum {
+            int64_t count = 0;
+            int64_t error = 0;
+        };
+
+        flat_hash_map<std::string_view, sum> sums;
+        int64_t floors = 0;
+
+        for (const bucket& bucket : window.buckets) {
+            if (bucket.number <= current - buckets || bucket.number > current) {
+                continue;
+            }
+
+            int64_t floor = bucket.summary.floor();
+            floors += floor;
+
+            for (const trending_tag& tag : bucket.summary.counters()) {
+                sum& sum = sums[std::string_view { tag.name }];
+                sum.count += tag.count - floor;
+                sum.error += tag.error - floor;
+            }
+        }
+
+        window.merged.clear();
+        window.merged.reserve(sums.size());
+        for (const auto& [name, sum] : sums) {
+            window.merged.push_back(trending_tag {
+                .name = std::string { name },
+                .count = static_cast<uint32_t>(sum.count + floors),
+                .error = static_cast<uint32_t>(sum.error + floors),
+            });
+        }
+
+        std::ranges::sort(window.merged, [](const trending_tag& l, const trending_tag& r) {
+            return (l.count != r.count) ? (l.count > r.count) : (l.name < r.name);
+        });
+
+        window.merged_number = current;
+    }
+
+    limit = std::min(limit, window.merged.size());
+    return { window.merged.begin(), window.merged.begin() + limit };
+}
+
+int64_t trending_tags::last_id() const {
+    std::scoped_lock lock { _lock };
+
+    return _last_id;
+}
+
+size_t trending_tags::memory_usage() const {
+    std::scoped_lock lock { _lock };
+
+    size_t res = 0;
+    for (const window& window : _windows) {
+        res += window.buckets.capacity() * sizeof(bucket);
+        for (const bucket& bucket : window.buckets) {
+            res += bucket.summary.memory_usage();
+        }
+
+        res += window.merged.capacity() * sizeof(trending_tag);
+        for (const trending_tag& tag : window.merged) {
+            res += tag.name.capacity();
+        }
+    }
+
+    return res;
+}
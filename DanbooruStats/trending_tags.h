@@ -0,0 +1,104 @@
+#ifndef TRENDING_TAGS_H
+#define TRENDING_TAGS_H
+
+#include "flat_hash_map.h"
+#include "version_feed.h"
+
+#include <magic_enum_containers.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* A tag counted by a space_saving summary, it was added between count - error and count times */
+struct trending_tag {
+    std::string name;
+    uint32_t count;
+    uint32_t error;
+};
+
+/* Space-Saving summary of the most frequent keys of a stream in bounded memory. Once capacity
+ * keys are monitored, a new key replaces the least frequent one and inherits its count as error,
+ * so every key making up more than 1 / capacity of the stream is monitored.
+ */
+class space_saving {
+    size_t _capacity;
+
+    /* Min-heap by count */
+    std::vector<trending_tag> _heap;
+    flat_hash_map<std::string, uint32_t> _positions;
+
+    public:
+    explicit space_saving(size_t capacity);
+
+    void add(std::string_view key);
+    void clear();
+
+    /* Count of the least frequent key if all keys are monitored, 0 otherwise */
+    [[nodiscard]] uint32_t floor() const;
+
+    /* In no particular order */
+    [[nodiscard]] std::span<const trending_tag> counters() const;
+
+    [[nodiscard]] size_t memory_usage() const;
+
+    private:
+    void _swap(uint32_t a, uint32_t b);
+    void _sift_up(uint32_t index);
+    void _sift_down(uint32_t index);
+};
+
+enum class trend_window {
+    hour,
+    day,
+    week,
+};
+
+/* Tags added most often by recent post versions. Every window is a ring of space_saving summaries
+ * of consecutive time buckets, old buckets are cleared as they are reused. A window covers the
+ * current bucket and the ones before it, so the last hour is between 55 and 60 minutes.
+ */
+class trending_tags {
+    struct bucket {
+        /* Bucket number since the epoch, -1 if unused */
+        int64_t number = -1;
+        space_saving summary;
+    };
+
+    struct window {
+        std::chrono::seconds width;
+        std::vector<bucket> buckets;
+
+        /* All buckets merged, sorted by count, valid until something is added or time moves on */
+        int64_t merged_number = -1;
+        std::vector<trending_tag> merged;
+    };
+
+    mutable std::mutex _lock;
+    mutable magic_enum::containers::array<trend_window, window> _windows;
+
+    int64_t _last_id = 0;
+
+    public:
+    /* Tags monitored per bucket */
+    static constexpr size_t default_capacity = 1024;
+
+    explicit trending_tags(size_t capacity = default_capacity);
+
+    /* Count the added tags of versions in the buckets of their update time. Versions up to the last
+     * added ID are skipped, so the same feed can be replayed.
+     */
+    void add(std::span<const post_version> versions);
+
+    /* Up to limit tags by count descending, merged once per change */
+    [[nodiscard]] std::vector<trending_tag> top(trend_window window, size_t limit) const;
+
+    [[nodiscard]] int64_t last_id() const;
+    [[nodiscard]] size_t memory_usage() const;
+};
+
+#endif /* TRENDING_TAGS_H */
@@ -0,0 +1,138 @@
+#include "user_cache.h"
+
+#include "database.h"
+
+#include <spdlog/spdlog.h>
+
+user_cache::user_cache(size_t budget) : _budget { budget } {
+
+}
+
+user_cache::value_type user_cache::get(int32_t id, const std::function<value_type()>& compute) {
+    std::promise<value_type> promise;
+
+    {
+        std::unique_lock lock { _lock };
+
+        if (auto it = _entries.find(id); it != _entries.end()) {
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            _lru.splice(_lru.begin(), _lru, it->second.lru);
+
+            /* Don't hold the lock while waiting for a calculation in progress */
+            auto value = it->second.value;
+            lock.unlock();
+
+            return value.get();
+        }
+
+        _misses.fetch_add(1, std::memory_order_relaxed);
+
+        _lru.push_front(id);
+        _entries.emplace(id, entry { .value = promise.get_future().share(), .lru = _lru.begin() });
+    }
+
+    value_type value;
+    try {
+        value = compute();
+    } catch (...) {
+        /* Anyone waiting gets the exception, the next request tries again */
+        {
+            std::scoped_lock lock { _lock };
+            if (auto it = _entries.find(id); it != _entries.end()) {
+                _lru.erase(it->second.lru);
+                _entries.erase(it);
+            }
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    promise.set_value(value);
+
+    {
+        std::scoped_lock lock { _lock };
+
+        /* May have been cleared in the meantime */
+        if (auto it = _entries.find(id); it != _entries.end() && it->second.bytes == 0) {
+            it->second.bytes = value->memory_usage();
+            _bytes += it->second.bytes;
+            _evict();
+        }
+    }
+
+    return value;
+}
+
+void user_cache::update(int32_t id, const std::function<void(user_stats&)>& modify) {
+    std::scoped_lock lock { _lock };
+
+    auto it = _entries.find(id);
+    if (it == _entries.end()) {
+        return;
+    }
+
+    if (it->second.bytes == 0) {
+        /* The calculation may have missed the update, let the next request start over */
+        _lru.erase(it->second.lru);
+        _entries.erase(it);
+        return;
+    }
+
+    auto value = it->second.value.get();
+    modify(*value);
+
+    /* Modifying may have copied mapped memory */
+    _bytes -= it->second.bytes;
+    it->second.bytes = value->memory_usage();
+    _bytes += it->second.bytes;
+
+    _evict();
+}
+
+user_cache::counters user_cache::stats() const {
+    std::scoped_lock lock { _lock };
+
+    return {
+        .hits = _hits.load(std::memory_order_relaxed),
+        .misses = _misses.load(std::memory_order_relaxed),
+        .evictions = _evictions.load(std::memory_order_relaxed),
+        .entries = _entries.size(),
+        .bytes = _bytes,
+        .budget = _budget,
+    };
+}
+
+memory_footprint user_cache::footprint() const {
+    std::scoped_lock lock { _lock };
+
+    return { .owned = _bytes + node_container_bytes(_entries) + node_container_bytes(_lru) };
+}
+
+void user_cache::clear() {
+    std::scoped_lock lock { _lock };
+
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0;
+}
+
+void user_cache::_evict() {
+    auto it = _lru.end();
+    while (_bytes > _budget && it != _lru.begin()) {
+        --it;
+
+        auto entry = _entries.find(*it);
+        if (entry->second.bytes == 0) {
+            continue;
+        }
+
+        spdlog::debug("Evicting user #{} ({} bytes)", *it, entry->second.bytes);
+
+        _bytes -= entry->second.bytes;
+        _entries.erase(entry);
+        it = _lru.erase(it);
+
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include "memory_footprint.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+class user_stats;
+
+/* Thread-safe LRU cache of user stats, bounded by the memory used by the cached stats */
+class user_cache {
+    public:
+    /* Only modified through update, while nobody else is reading */
+    using value_type = std::shared_ptr<user_stats>;
+
+    struct counters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+
+    private:
+    struct entry {
+        std::shared_future<value_type> value;
+
+        /* Position in _lru */
+        std::list<int32_t>::iterator lru;
+
+        /* 0 while still being calculated, these are never evicted */
+        size_t bytes = 0;
+    };
+
+    mutable std::mutex _lock;
+    std::unordered_map<int32_t, entry> _entries;
+
+    /* Most recently used first */
+    std::list<int32_t> _lru;
+
+    size_t _budget;
+    size_t _bytes = 0;
+
+    std::atomic<uint64_t> _hits { 0 };
+    std::atomic<uint64_t> _misses { 0 };
+    std::atomic<uint64_t> _evictions { 0 };
+
+    public:
+    explicit user_cache(size_t budget);
+
+    /* Return the cached stats for a user, or calculate them using compute.
+     * Concurrent calls for the same user wait for a single calculation.
+     */
+    [[nodiscard]] value_type get(int32_t id, const std::function<value_type()>& compute);
+
+    /* Modify the stats of a user if they're cached, dropping them if they're still being calculated */
+    void update(int32_t id, const std::function<void(user_stats&)>& modify);
+
+    [[nodiscard]] counters stats() const;
+
+    /* The cached stats plus the cache's own bookkeeping */
+    [[nodiscard]] memory_footprint footprint() const;
+
+    void clear();
+
+    private:
+    /* Evict least recently used entries until we're within budget, requires _lock */
+    void _evict();
+};
+
+#endif /* USER_CACHE_H */
@@ -0,0 +1,192 @@
+#include "user_leaderboards.h"
+
+#include "thread_pool.h"
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+
+using std::chrono::steady_clock;
+
+/* Ties are ordered by ID, like tag rankings */
+static constexpr auto by_rank = [](const user_value& l, const user_value& r) -> bool {
+    return (l.value != r.value) ? (l.value > r.value) : (l.user_id < r.user_id);
+};
+
+user_leaderboards::~user_leaderboards() {
+    /* The pool may still be referring to us */
+    if (_complete.valid()) {
+        _complete.wait();
+    }
+}
+
+void user_leaderboards::build(std::vector<source> sources, thread_pool& pool) {
+    wait();
+
+    auto promise = std::make_shared<std::promise<void>>();
+    _complete = promise->get_future().share();
+
+    pool.submit([this, sources = std::move(sources), &pool, promise] {
+        try {
+            _build(sources, pool);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+size_t user_leaderboards::size(user_metric metric) const {
+    wait();
+
+    return _order[metric].size();
+}
+
+std::span<const user_value> user_leaderboards::page(user_metric metric, size_t offset, size_t limit) const {
+    wait();
+
+    const auto& order = _order[metric];
+    if (offset >= order.size()) {
+        return {};
+    }
+
+    return std::span { order }.subspan(offset, std::min(limit, order.size() - offset));
+}
+
+std::optional<uint32_t> user_leaderboards::rank(user_metric metric, int32_t user_id) const {
+    wait();
+
+    auto it = _slots.find(user_id);
+    if (it == _slots.end() || _ranks[metric][it->second] == no_rank) {
+        return std::nullopt;
+    }
+
+    return _ranks[metric][it->second];
+}
+
+memory_footprint user_leaderboards::footprint() const {
+    /* Nothing is there until it's built */
+    if (!_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready) {
+        return {};
+    }
+
+    memory_footprint res { .owned = map_bytes(_slots) };
+    for (user_metric metric : magic_enum::enum_values<user_metric>()) {
+        res.owned += (_order[metric].capacity() * sizeof(user_value)) + (_ranks[metric].capacity() * sizeof(uint32_t));
+    }
+
+    return res;
+}
+
+bool user_leaderboards::ready() const {
+    return !_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready;
+}
+
+void user_leaderboards::wait() const {
+    if (_complete.valid()) {
+        _complete.get();
+    }
+}
+
+void user_leaderboards::_build(std::span<const source> sources, thread_pool& pool) {
+    auto begin = steady_clock::now();
+
+    /* Every user gets a slot, with the posts of all sources grouped by slot */
+    flat_hash_map<int32_t, uint32_t> slots;
+    std::vector<int32_t> user_ids;
+    std::vector<uint32_t> offsets;
+
+    for (const source& source : sources) {
+        for (const auto& [user_id, posts] : source.users) {
+            if (slots.try_emplace(user_id, static_cast<uint32_t>(user_ids.size())).second) {
+                user_ids.push_back(user_id);
+            }
+        }
+    }
+
+    offsets.assign(user_ids.size() + 1, 0);
+    for (const source& source : sources) {
+        for (const auto& [user_id, posts] : source.users) {
+            offsets[slots.at(user_id) + 1] += 1;
+        }
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    /* (source, user in source) */
+    std::vector<std::pair<uint32_t, uint32_t>> parts(offsets.back());
+    std::vector<uint32_t> filled { offsets.begin(), offsets.end() - 1 };
+    for (uint32_t s = 0; s < sources.size(); ++s) {
+        for (uint32_t i = 0; i < sources[s].users.size(); ++i) {
+            parts[filled[slots.at(sources[s].users[i].first)]++] = { s, i };
+        }
+    }
+
+    user_metric_array<std::vector<int32_t>> values;
+    for (auto& metric_values : values) {
+        metric_values.resize(user_ids.size());
+    }
+
+    /* Unique tags are a sort of all tags of a user, of any year */
+    static constexpr size_t grain = 64;
+    pool.parallel_for(user_ids.size(), [&](size_t slot) {
+        std::vector<tag_id> tags;
+
+        for (uint32_t part = offsets[slot]; part < offsets[slot + 1]; ++part) {
+            const auto& [s, i] = parts[part];
+            values[user_metric::posts][slot] += static_cast<int32_t>(sources[s].users[i].second.size());
+        }
+
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            tags.clear();
+
+            for (uint32_t part = offsets[slot]; part < offsets[slot + 1]; ++part) {
+                const auto& [s, i] = parts[part];
+                const tag_column& column = sources[s].posts->tags(type);
+
+                for (post_row row : sources[s].users[i].second) {
+                    auto row_tags = column[row];
+                    tags.insert(tags.end(), row_tags.begin(), row_tags.end());
+                }
+            }
+
+            std::ranges::sort(tags);
+
+            values[metric_for(type)][slot] = static_cast<int32_t>(std::ranges::unique(tags).begin() - tags.begin());
+        }
+    }, grain);
+
+    user_metric_array<std::vector<user_value>> order;
+    user_metric_array<std::vector<uint32_t>> ranks;
+
+    const auto& slot_of = slots;
+    auto metrics = magic_enum::enum_values<user_metric>();
+    pool.parallel_for(metrics.size(), [&](size_t i) {
+        user_metric metric = metrics[i];
+
+        for (size_t slot = 0; slot < user_ids.size(); ++slot) {
+            if (values[metric][slot] > 0) {
+                order[metric].push_back({ user_ids[slot], values[metric][slot] });
+            }
+        }
+
+        std::ranges::sort(order[metric], by_rank);
+
+        ranks[metric].assign(user_ids.size(), no_rank);
+        for (size_t pos = 0; pos < order[metric].size(); ++pos) {
+            ranks[metric][slot_of.at(order[metric][pos].user_id)] = static_cast<uint32_t>(pos);
+        }
+    });
+
+    /* Nobody looks at these until we're done */
+    _slots = std::move(slots);
+    _order = std::move(order);
+    _ranks = std::move(ranks);
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Ranked {} users over {} sources in {}", user_ids.size(), sources.size(), end - begin);
+}
@@ -0,0 +1,101 @@
+#ifndef USER_LEADERBOARDS_H
+#define USER_LEADERBOARDS_H
+
+#include "flat_hash_map.h"
+#include "memory_footprint.h"
+#include "post_table.h"
+
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+class thread_pool;
+
+/* What users are ranked by: posts, or unique tags of a category */
+enum class user_metric {
+    posts,
+    general,
+    artist,
+    copyright,
+    character,
+    meta,
+};
+
+template <typename T>
+using user_metric_array = magic_enum::containers::array<user_metric, T>;
+
+[[nodiscard]] constexpr user_metric metric_for(tag_type type) {
+    switch (type) {
+        case tag_type::general:   return user_metric::general;
+        case tag_type::artist:    return user_metric::artist;
+        case tag_type::copyright: return user_metric::copyright;
+        case tag_type::character: return user_metric::character;
+        case tag_type::meta:      return user_metric::meta;
+    }
+
+    std::unreachable();
+}
+
+struct user_value {
+    int32_t user_id;
+    int32_t value;
+};
+
+/* Users ordered by every metric descending, with the position of every user in each.
+ * Sorted once on the pool, after which every lookup is O(1). Users with nothing for a
+ * metric aren't ranked by it.
+ */
+class user_leaderboards {
+    public:
+    /* Posts of every user, several are counted as one (unique tags are counted over all of them) */
+    struct source {
+        const post_table* posts;
+        std::vector<std::pair<int32_t, std::span<const post_row>>> users;
+    };
+
+    private:
+    static constexpr uint32_t no_rank = std::numeric_limits<uint32_t>::max();
+
+    /* Index into _ranks of every user */
+    flat_hash_map<int32_t, uint32_t> _slots;
+
+    user_metric_array<std::vector<user_value>> _order;
+    user_metric_array<std::vector<uint32_t>> _ranks;
+
+    std::shared_future<void> _complete;
+
+    public:
+    user_leaderboards() = default;
+    ~user_leaderboards();
+
+    user_leaderboards(const user_leaderboards&) = delete;
+    user_leaderboards& operator=(const user_leaderboards&) = delete;
+
+    /* Count and rank the users of all sources (whose posts must outlive this) in the background */
+    void build(std::vector<source> sources, thread_pool& pool);
+
+    [[nodiscard]] size_t size(user_metric metric) const;
+
+    /* Up to limit users starting at offset */
+    [[nodiscard]] std::span<const user_value> page(user_metric metric, size_t offset, size_t limit) const;
+
+    /* 0-based position of a user, if they're ranked */
+    [[nodiscard]] std::optional<uint32_t> rank(user_metric metric, int32_t user_id) const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    /* Whether building is done, without waiting */
+    [[nodiscard]] bool ready() const;
+
+    /* Wait until building is done */
+    void wait() const;
+
+    private:
+    void _build(std::span<const source> sources, thread_pool& pool);
+};
+
+#endif /* USER_LEADERBOARDS_H */
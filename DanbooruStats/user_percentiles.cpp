@@ -0,0 +1,149 @@
+#include "user_percentiles.h"
+
+#include "thread_pool.h"
+#include "util.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+
+using std::chrono::steady_clock;
+
+user_percentiles::~user_percentiles() {
+    /* The pool may still be referring to us */
+    if (_complete.valid()) {
+        _complete.wait();
+    }
+}
+
+void user_percentiles::build(std::vector<source> sources, size_t tags, thread_pool& pool) {
+    wait();
+
+    auto promise = std::make_shared<std::promise<void>>();
+    _complete = promise->get_future().share();
+
+    pool.submit([this, sources = std::move(sources), tags, &pool, promise] {
+        try {
+            _build(sources, tags, pool);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+std::optional<user_percentiles::standing> user_percentiles::standing_of(tag_id tag, int32_t count) const {
+    wait();
+
+    if (tag + size_t { 1 } >= _offsets.size() || _offsets[tag] == _offsets[tag + 1]) {
+        return std::nullopt;
+    }
+
+    std::span<const bucket> buckets = std::span { _buckets }.subspan(_offsets[tag], _offsets[tag + 1] - _offsets[tag]);
+    uint32_t users = buckets.back().users;
+
+    /* First count that's at least as large */
+    auto it = std::ranges::lower_bound(buckets, count, {}, &bucket::count);
+    uint32_t fewer = (it == buckets.begin()) ? 0 : std::prev(it)->users;
+    uint32_t at_most = (it != buckets.end() && it->count == count) ? it->users : fewer;
+
+    return standing {
+        .rank = users - at_most + 1,
+        .users = users,
+        .percentile = 100. * at_most / users,
+    };
+}
+
+memory_footprint user_percentiles::footprint() const {
+    /* Nothing is there until it's built */
+    if (!_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) != std::future_status::ready) {
+        return {};
+    }
+
+    return { .owned = (_offsets.capacity() * sizeof(uint32_t)) + (_buckets.capacity() * sizeof(bucket)) };
+}
+
+bool user_percentiles::ready() const {
+    return !_complete.valid() || _complete.wait_for(std::chrono::seconds { 0 }) == std::future_status::ready;
+}
+
+void user_percentiles::wait() const {
+    if (_complete.valid()) {
+        _complete.get();
+    }
+}
+
+void user_percentiles::_build(std::span<const source> sources, size_t tags, thread_pool& pool) {
+    auto begin = steady_clock::now();
+
+    static constexpr size_t batch_size = 1024;
+    size_t batches = (tags + batch_size - 1) / batch_size;
+
+    /* Buckets of every batch of tags, and where the buckets of every tag in it end */
+    std::vector<std::vector<bucket>> batch_buckets(batches);
+    std::vector<uint32_t> ends(tags);
+
+    pool.parallel_for(batches, [&](size_t batch) {
+        std::vector<int32_t> uploaders;
+        std::vector<int32_t> counts;
+
+        size_t last = std::min(tags, (batch + 1) * batch_size);
+        for (size_t tag = batch * batch_size; tag < last; ++tag) {
+            uploaders.clear();
+            for (const source& source : sources) {
+                std::span<const int32_t> uploader_ids = source.posts->uploader_ids();
+                (*source.index)[static_cast<tag_id>(tag)].for_each([&](post_row row) {
+                    uploaders.push_back(uploader_ids[row]);
+                });
+            }
+
+            /* Posts per user, then users per count */
+            std::ranges::sort(uploaders);
+
+            counts.clear();
+            for (size_t i = 0; i < uploaders.size();) {
+                size_t first = i;
+                while (i < uploaders.size() && uploaders[i] == uploaders[first]) {
+                    ++i;
+                }
+
+                counts.push_back(static_cast<int32_t>(i - first));
+            }
+
+            std::ranges::sort(counts);
+
+            std::vector<bucket>& buckets = batch_buckets[batch];
+            for (size_t i = 0; i < counts.size(); ++i) {
+                if (i + 1 == counts.size() || counts[i + 1] != counts[i]) {
+                    buckets.push_back({ counts[i], static_cast<uint32_t>(i + 1) });
+                }
+            }
+
+            ends[tag] = static_cast<uint32_t>(buckets.size());
+        }
+    });
+
+    std::vector<uint32_t> offsets(tags + 1);
+    std::vector<bucket> all_buckets;
+
+    uint32_t base = 0;
+    for (size_t batch = 0; batch < batches; ++batch) {
+        size_t last = std::min(tags, (batch + 1) * batch_size);
+        for (size_t tag = batch * batch_size; tag < last; ++tag) {
+            offsets[tag + 1] = base + ends[tag];
+        }
+
+        base += static_cast<uint32_t>(batch_buckets[batch].size());
+        all_buckets.insert(all_buckets.end(), batch_buckets[batch].begin(), batch_buckets[batch].end());
+        batch_buckets[batch] = {};
+    }
+
+    /* Nobody looks at these until we're done */
+    _offsets = std::move(offsets);
+    _buckets = std::move(all_buckets);
+
+    auto end = steady_clock::now();
+
+    spdlog::info("Counted users of {} tags over {} sources ({} buckets) in {}", tags, sources.size(), _buckets.size(), end - begin);
+}
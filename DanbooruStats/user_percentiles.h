@@ -0,0 +1,73 @@
+#ifndef USER_PERCENTILES_H
+#define USER_PERCENTILES_H
+
+#include "memory_footprint.h"
+#include "post_table.h"
+#include "posting_index.h"
+
+#include <cstdint>
+#include <future>
+#include <optional>
+#include <span>
+#include <vector>
+
+class thread_pool;
+
+/* How many posts with every tag each of it's users has. Stored per tag as the distinct counts
+ * ascending, with the number of users having at most that many, so the standing of a user among
+ * the users of a tag is a binary search.
+ */
+class user_percentiles {
+    public:
+    /* Posts and their index, several are counted as one (summing the counts of every user) */
+    struct source {
+        const post_table* posts;
+        const posting_index* index;
+    };
+
+    struct standing {
+        /* 1-based, users with the same count share a rank */
+        uint32_t rank;
+        uint32_t users;
+
+        /* Share of users with at most as many posts */
+        double percentile;
+    };
+
+    private:
+    struct bucket {
+        int32_t count;
+        uint32_t users;
+    };
+
+    std::vector<uint32_t> _offsets;
+    std::vector<bucket> _buckets;
+
+    std::shared_future<void> _complete;
+
+    public:
+    user_percentiles() = default;
+    ~user_percentiles();
+
+    user_percentiles(const user_percentiles&) = delete;
+    user_percentiles& operator=(const user_percentiles&) = delete;
+
+    /* Count the users of the first tags tags of all sources (which must outlive this) in the background */
+    void build(std::vector<source> sources, size_t tags, thread_pool& pool);
+
+    /* Standing of a user with count posts with tag, if anyone has the tag */
+    [[nodiscard]] std::optional<standing> standing_of(tag_id tag, int32_t count) const;
+
+    [[nodiscard]] memory_footprint footprint() const;
+
+    /* Whether building is done, without waiting */
+    [[nodiscard]] bool ready() const;
+
+    /* Wait until building is done */
+    void wait() const;
+
+    private:
+    void _build(std::span<const source> sources, size_t tags, thread_pool& pool);
+};
+
+#endif /* USER_PERCENTILES_H */
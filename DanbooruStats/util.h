@@ -48,4 +48,27 @@ template <> struct fmt::formatter<std::chrono::nanoseconds> {
     }
 };
 
+struct format_bytes {
+    format_bytes(size_t count) : count { count } { }
+    size_t count;
+};
+
+template <> struct fmt::formatter<format_bytes> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const format_bytes& bytes, format_context& ctx) const {
+        if (bytes.count < 1024) {
+            return fmt::format_to(ctx.out(), "{} bytes", bytes.count);
+        } else if (bytes.count < size_t { 1024 } * 1024) {
+            return fmt::format_to(ctx.out(), "{:.3f} KiB", bytes.count / 1024.);
+        } else if (bytes.count < size_t { 1024 } * 1024 * 1024) {
+            return fmt::format_to(ctx.out(), "{:.3f} MiB", bytes.count / 1024. / 1024.);
+        }
+
+        return fmt::format_to(ctx.out(), "{:.3f} GiB", bytes.count / 1024. / 1024. / 1024.);
+    }
+};
+
 #endif /* UTIL_H */
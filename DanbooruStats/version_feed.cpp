@@ -0,0 +1,58 @@
+#include "version_feed.h"
+
+#include "tag_tokenizer.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <spdlog/spdlog.h>
+
+static std::vector<std::string> split_tags(tag_tokenizer& tokenizer, std::string_view tag_string) {
+    auto tags = tokenizer.split(tag_string);
+    return std::vector<std::string>(tags.begin(), tags.end());
+}
+
+version_feed::version_feed(std::string path, int64_t last_id)
+    : _path { std::move(path) }, _last_id { last_id } {
+
+}
+
+std::vector<post_version> version_feed::next(size_t limit) {
+    /* Reopened every batch, so the collecting tool can keep writing in between */
+    SQLite::Database db { _path, SQLite::OPEN_READONLY };
+    SQLite::Statement query { db, "select id, post_id, cast(strftime('%s', updated_at) as integer), added_tags, removed_tags from post_versions where id > ? order by id limit ?" };
+    query.bind(1, _last_id);
+    query.bind(2, static_cast<int64_t>(limit));
+
+    tag_tokenizer tokenizer;
+
+    /* Versions without a time still change tags, they're counted as trending now instead of in 1970 */
+    auto now = std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
+    size_t untimed = 0;
+
+    std::vector<post_version> res;
+    while (query.executeStep()) {
+        bool timed = !query.getColumn(2).isNull();
+        untimed += timed ? 0 : 1;
+
+        res.push_back(post_version {
+            .id = query.getColumn(0).getInt64(),
+            .post_id = query.getColumn(1).getInt(),
+            .updated_at = timed ? std::chrono::sys_seconds { std::chrono::seconds { query.getColumn(2).getInt64() } } : now,
+            .added_tags = split_tags(tokenizer, query.getColumn(3).getText()),
+            .removed_tags = split_tags(tokenizer, query.getColumn(4).getText()),
+        });
+    }
+
+    if (untimed > 0) {
+        spdlog::warn("{} post versions up to {} have no valid updated_at, using the time they were read", untimed, res.back().id);
+    }
+
+    if (!res.empty()) {
+        _last_id = res.back().id;
+    }
+
+    return res;
+}
+
+int64_t version_feed::last_id() const {
+    return _last_id;
+}
@@ -0,0 +1,36 @@
+#ifndef VERSION_FEED_H
+#define VERSION_FEED_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Tag changes of a single post_versions row */
+struct post_version {
+    int64_t id;
+    int32_t post_id;
+    std::chrono::sys_seconds updated_at;
+
+    std::vector<std::string> added_tags;
+    std::vector<std::string> removed_tags;
+};
+
+/* Reads post_versions rows (as collected by ensure_coherent_post_versions) in order of ID,
+ * picking up where the previous batch left off.
+ */
+class version_feed {
+    std::string _path;
+    int64_t _last_id;
+
+    public:
+    /* Only versions with an ID above last_id are returned */
+    explicit version_feed(std::string path, int64_t last_id = 0);
+
+    /* Return up to limit versions following the previously returned ones */
+    [[nodiscard]] std::vector<post_version> next(size_t limit);
+
+    [[nodiscard]] int64_t last_id() const;
+};
+
+#endif /* VERSION_FEED_H */
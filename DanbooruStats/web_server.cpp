@@ -1,27 +1,84 @@
 #include "web_server.h"
 
 #include "danbooru.h"
-#include "database.h"
+#include "live_dataset.h"
+#include "trending_tags.h"
 #include "util.h"
 
 #include <magic_enum.hpp>
 #include <spdlog/spdlog.h>
 
+#include <charconv>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <queue>
 #include <chrono>
+#include <ranges>
 
 using std::chrono::steady_clock;
 
+/* Numeric query parameter, or def if it's not present. Returns nullopt if it's invalid. */
+template <typename T>
+static std::optional<T> numeric_param(const httplib::Request& req, const std::string& key, T def) {
+    if (!req.has_param(key)) {
+        return def;
+    }
+
+    std::string value = req.get_param_value(key);
+
+    T res;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), res);
+    if (ec != std::errc {} || ptr != value.data() + value.size()) {
+        return std::nullopt;
+    }
+
+    return res;
+}
+
+/* Group key as shown, ratings and file extensions are stored as characters. A NULL rating is stored as 0. */
+static inja::json aggregate_key_json(post_column column, int64_t key) {
+    switch (column) {
+        case post_column::rating:   return (key == 0) ? inja::json() : inja::json(std::string(1, static_cast<char>(key)));
+        case post_column::file_ext: return unpack_file_ext(static_cast<uint32_t>(key));
+        default:                    return key;
+    }
+}
+
+/* Type of the static files worth compressing, by extension. Empty for any other file */
+static std::string_view compressible_static_type(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+
+    if (extension == ".html") { return "text/html"; }
+    if (extension == ".css")  { return "text/css"; }
+    if (extension == ".js")   { return "text/javascript"; }
+    if (extension == ".json") { return "application/json"; }
+    if (extension == ".svg")  { return "image/svg+xml"; }
+    if (extension == ".txt")  { return "text/plain"; }
+    return {};
+}
+
+/* Estimate of a sketch with its standard error */
+static inja::json estimate_json(const hyperloglog& sketch) {
+    double estimate = sketch.estimate();
+
+    return {
+        { "estimate", std::llround(estimate) },
+        { "error", std::llround(estimate * hyperloglog::relative_error()) },
+        { "relative_error", hyperloglog::relative_error() },
+    };
+}
+
 web_server::~web_server() {
     _watcher.removeWatch(_watch_id);
 }
 
-web_server::web_server(danbooru& danbooru, database& db, const std::string& template_path, const std::string& static_path)
+web_server::web_server(danbooru& danbooru, live_dataset& data, trending_tags& trending, size_t page_cache_budget, const std::string& template_path, const std::string& static_path)
     : _template_path{ std::filesystem::canonical(template_path) }
     , _static_path{ std::filesystem::canonical(static_path) }
     , _inja{ template_path /* fs::canonical removes the trailing slash, breaking inja */ }
-    , _danbooru { danbooru }, _db { db } {
+    , _pages { page_cache_budget }
+    , _danbooru { danbooru }, _data { data }, _trending { trending } {
 
     spdlog::info("Loading templates from {}", _template_path.string());
 
@@ -41,6 +98,19 @@ web_server::web_server(danbooru& danbooru, database& db, const std::string& temp
     });
 
     _server.set_exception_handler([](const httplib::Request& req, httplib::Response& res, std::exception_ptr ep) {
+        /* Something is still being built, not an error */
+        try {
+            std::rethrow_exception(ep);
+        } catch (const not_ready& e) {
+            spdlog::info("[{}] {} - {}: {}", req.remote_addr, req.method, req.path, e.what());
+
+            res.set_content(std::format("<h1>Error 503</h1><p>{}, try again later</p>", e.what()), "text/html");
+            res.set_header("Retry-After", "10");
+            res.status = 503;
+            return;
+        } catch (...) {
+        }
+
         spdlog::error("[{}] {} - {}: {}", req.remote_addr, req.method, req.path, "Exception:");
 
         constexpr std::string_view fmt = "<h1>Error 500</h1><p>{}</p>";
@@ -68,14 +138,68 @@ web_server::web_server(danbooru& danbooru, database& db, const std::string& temp
         throw std::runtime_error{ std::format("Static file directory does not exist: {}", static_path_string) };
     }
 
+    /* Compressed static files, anything else falls through to the mount point */
+    _server.set_pre_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
+        if (req.method == "GET" && req.path.starts_with("/static/") && this->_compressed_static(req, res)) {
+            return httplib::Server::HandlerResponse::Handled;
+        }
+
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+
     /* Dynamic routing */
     
     _server.Get(R"(/user/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
-        this->user(std::stoi(req.matches[1]), req, res);
+        /* A renamed or deleted user shows as they were for up to user_page_max_age, or until the data changes */
+        this->_cached_page(template_id::user, { "top" }, req, res, [&] {
+            this->user(std::stoi(req.matches[1]), req, res);
+        }, user_page_max_age);
     });
 
     _server.Get("/tags/([a-z]+)", [this](const httplib::Request& req, httplib::Response& res) {
-        this->tags(req.matches[1], req, res);
+        this->_cached_page(template_id::tags, { "offset", "limit" }, req, res, [&] {
+            this->tags(req.matches[1], req, res);
+        });
+    });
+
+    _server.Get("/users/top/([a-z]+)", [this](const httplib::Request& req, httplib::Response& res) {
+        this->top_users(req.matches[1], req, res);
+    });
+
+    _server.Get("/distinct/tags/([a-z]+)", [this](const httplib::Request& req, httplib::Response& res) {
+        this->distinct_tags(req.matches[1], req, res);
+    });
+
+    _server.Get("/distinct/users", [this](const httplib::Request& req, httplib::Response& res) {
+        this->distinct_users(req, res);
+    });
+
+    _server.Get("/trending/([a-z]+)", [this](const httplib::Request& req, httplib::Response& res) {
+        this->trending(req.matches[1], req, res);
+    });
+
+    _server.Get("/aggregate", [this](const httplib::Request& req, httplib::Response& res) {
+        this->aggregate(req, res);
+    });
+
+    _server.Get("/tag/([^/]+)/rank", [this](const httplib::Request& req, httplib::Response& res) {
+        this->tag_rank(req.matches[1], req, res);
+    });
+
+    _server.Get("/tag/([^/]+)/related", [this](const httplib::Request& req, httplib::Response& res) {
+        this->related_tags(req.matches[1], req, res);
+    });
+
+    _server.Get("/search", [this](const httplib::Request& req, httplib::Response& res) {
+        this->search(req, res);
+    });
+
+    _server.Get("/debug/cache", [this](const httplib::Request& req, httplib::Response& res) {
+        this->cache(req, res);
+    });
+
+    _server.Get("/debug/memory", [this](const httplib::Request& req, httplib::Response& res) {
+        this->memory(req, res);
     });
 
 }
@@ -86,6 +210,9 @@ void web_server::listen(const std::string& addr, uint16_t port) {
 }
 
 void web_server::user(int32_t id, const httplib::Request& req, httplib::Response& res) {
+    /* Pinned for the whole request, even if the data is swapped in the meantime */
+    auto db = _data.current();
+
     std::string username;
     if (!_danbooru.user_exists(id, username)) {
         res.set_content("User does not exist", "text/html");
@@ -97,16 +224,78 @@ void web_server::user(int32_t id, const httplib::Request& req, httplib::Response
         const auto& tmpl = _ensure_template(template_id::user);
         inja::json data;
 
-        user_stats& stats = _db.stats_for(id);
+        static constexpr size_t default_top = 10;
+
+        auto top = numeric_param<size_t>(req, "top", default_top);
+        if (!top || *top > user_stats::top_size) {
+            res.set_content(std::format("invalid top (at most {})", user_stats::top_size), "text/html");
+            res.status = 400;
+            return;
+        }
+
+        auto range = _year_range(*db, req);
+        if (!range) {
+            res.set_content("invalid year range", "text/html");
+            res.status = 400;
+            return;
+        }
+
+        auto lock = db->read_lock();
+        auto stats = db->stats_for(id, *range);
 
         data["user_name"] = username;
         data["user_id"] = id;
-        data["posts"] = stats.posts().size();
+        data["first_year"] = range->first;
+        data["last_year"] = range->last;
+        data["posts"] = stats.posts;
+
+        data["unique_general_tags"] = stats.tag_counts[tag_type::general].size();
+        data["unique_artists"] = stats.tag_counts[tag_type::artist].size();
+        data["unique_characters"] = stats.tag_counts[tag_type::character].size();
+        data["unique_copyrights"] = stats.tag_counts[tag_type::copyright].size();
+
+        /* A binary search per tag, instead of looking at every other user */
+        auto percentiles = db->percentiles(*range);
+
+        inja::json top_tags;
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            auto ranking = db->tag_rankings(type, *range);
+
+            auto tags_array = inja::json::array();
+            for (const auto& tag : std::span { stats.top_tags[type] }.first(std::min(*top, stats.top_tags[type].size()))) {
+                inja::json entry { { "tag", db->tag_name(tag.tag) }, { "count", tag.count } };
+
+                if (auto rank = ranking->rank(tag.tag)) {
+                    int32_t total = ranking->page(*rank, 1).front().count;
+                    entry["total_count"] = total;
+                    entry["share"] = 100. * tag.count / total;
+                }
+
+                if (auto standing = percentiles->standing_of(tag.tag, tag.count)) {
+                    entry["user_rank"] = standing->rank;
+                    entry["users"] = standing->users;
+                    entry["percentile"] = standing->percentile;
+                }
+
+                tags_array.push_back(std::move(entry));
+            }
 
-        data["unique_general_tags"] = stats.tag_count(tag_type::general).size();
-        data["unique_artists"] = stats.tag_count(tag_type::artist).size();
-        data["unique_characters"] = stats.tag_count(tag_type::character).size();
-        data["unique_copyrights"] = stats.tag_count(tag_type::copyright).size();
+            top_tags[magic_enum::enum_name(type)] = tags_array;
+        }
+
+        data["top_tags"] = top_tags;
+
+        /* Looked up, not counted */
+        auto leaderboards = db->leaderboards(*range);
+
+        inja::json ranks;
+        for (user_metric metric : magic_enum::enum_values<user_metric>()) {
+            if (auto rank = leaderboards->rank(metric, id)) {
+                ranks[magic_enum::enum_name(metric)] = { { "rank", *rank + 1 }, { "users", leaderboards->size(metric) } };
+            }
+        }
+
+        data["ranks"] = ranks;
 
         res.set_content(_inja.render(tmpl, data), "text/html");
     } catch (const std::out_of_range& e) {
@@ -116,7 +305,613 @@ void web_server::user(int32_t id, const httplib::Request& req, httplib::Response
     }
 }
 
+void web_server::top_users(const std::string& metric_name, const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    auto metric = magic_enum::enum_cast<user_metric>(metric_name);
+    if (!metric.has_value()) {
+        res.set_content(std::format("metric {} not found", metric_name), "text/html");
+        res.status = 404;
+        return;
+    }
+
+    static constexpr size_t default_limit = 25;
+    static constexpr size_t max_limit = 1000;
+
+    auto offset = numeric_param<size_t>(req, "offset", 0);
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!offset || !limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid offset or limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto lock = db->read_lock();
+    auto leaderboards = db->leaderboards(*range);
+
+    auto page = leaderboards->page(metric.value(), *offset, *limit);
+
+    auto users_array = inja::json::array();
+    for (const auto& user : page) {
+        users_array.push_back({ { "user_id", user.user_id }, { "value", user.value } });
+    }
+
+    inja::json data;
+    data["metric"] = metric_name;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["total_count"] = leaderboards->size(metric.value());
+    data["offset"] = *offset;
+    data["limit"] = *limit;
+    data["first_rank"] = *offset + 1;
+    data["users"] = users_array;
+
+    if (*offset > 0) {
+        data["prev_offset"] = *offset - std::min(*offset, *limit);
+    }
+
+    if (*offset + page.size() < leaderboards->size(metric.value())) {
+        data["next_offset"] = *offset + page.size();
+    }
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::distinct_tags(const std::string& category, const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    auto type = magic_enum::enum_cast<tag_type>(category);
+    if (!type.has_value()) {
+        res.set_content(std::format("category {} not found", category), "text/html");
+        res.status = 404;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    /* Comma-separated user IDs */
+    std::vector<int32_t> users;
+    for (auto part : std::views::split(std::string_view { req.get_param_value("users") }, ',')) {
+        std::string_view id { part.begin(), part.end() };
+        if (id.empty()) {
+            continue;
+        }
+
+        int32_t user_id;
+        auto [ptr, ec] = std::from_chars(id.data(), id.data() + id.size(), user_id);
+        if (ec != std::errc {} || ptr != id.data() + id.size()) {
+            res.set_content(std::format("invalid user ID {}", id), "text/html");
+            res.status = 400;
+            return;
+        }
+
+        users.push_back(user_id);
+    }
+
+    auto lock = db->read_lock();
+
+    inja::json data = estimate_json(db->distinct_tags(users, type.value(), *range));
+    data["category"] = category;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["users"] = users;
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::distinct_users(const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto lock = db->read_lock();
+
+    /* Space-separated tag names, unknown tags have no users */
+    std::vector<tag_id> tags;
+    auto names = inja::json::array();
+    for (auto part : std::views::split(std::string_view { req.get_param_value("tags") }, ' ')) {
+        std::string_view name { part.begin(), part.end() };
+        if (name.empty()) {
+            continue;
+        }
+
+        names.push_back(name);
+        if (auto tag = db->find_tag(name)) {
+            tags.push_back(*tag);
+        }
+    }
+
+    inja::json data = estimate_json(db->distinct_users(tags, *range));
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["tags"] = names;
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::trending(const std::string& window_name, const httplib::Request& req, httplib::Response& res) {
+    auto window = magic_enum::enum_cast<trend_window>(window_name);
+    if (!window.has_value()) {
+        res.set_content(std::format("window {} not found", window_name), "text/html");
+        res.status = 404;
+        return;
+    }
+
+    static constexpr size_t default_limit = 25;
+    static constexpr size_t max_limit = 1000;
+
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto tags_array = inja::json::array();
+    for (const trending_tag& tag : _trending.top(window.value(), *limit)) {
+        tags_array.push_back({ { "tag", tag.name }, { "count", tag.count }, { "error", tag.error } });
+    }
+
+    inja::json data;
+    data["window"] = window_name;
+    data["last_version"] = _trending.last_id();
+    data["tags"] = tags_array;
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::aggregate(const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    static constexpr size_t default_limit = 100;
+    static constexpr size_t max_limit = 10000;
+
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    /* Comma-separated columns, numeric ones optionally bucketed as column:bucket */
+    aggregate_query query;
+    for (auto part : std::views::split(std::string_view { req.get_param_value("group") }, ',')) {
+        std::string_view group { part.begin(), part.end() };
+        std::string_view name = group.substr(0, group.find(':'));
+
+        auto column = magic_enum::enum_cast<post_column>(name);
+        if (!column.has_value()) {
+            res.set_content(std::format("column {} not found", name), "text/html");
+            res.status = 400;
+            return;
+        }
+
+        int64_t bucket = 1;
+        if (name.size() < group.size()) {
+            std::string_view bucket_string = group.substr(name.size() + 1);
+            auto [ptr, ec] = std::from_chars(bucket_string.data(), bucket_string.data() + bucket_string.size(), bucket);
+            if (ec != std::errc {} || ptr != bucket_string.data() + bucket_string.size() || bucket <= 0) {
+                res.set_content(std::format("invalid bucket {}", bucket_string), "text/html");
+                res.status = 400;
+                return;
+            }
+        }
+
+        query.groups.push_back({ .column = column.value(), .bucket = bucket });
+    }
+
+    if (query.groups.empty() || query.groups.size() > 2) {
+        res.set_content("group by one or two columns", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    if (req.has_param("measure")) {
+        query.measure = magic_enum::enum_cast<post_column>(req.get_param_value("measure"));
+        if (!query.measure) {
+            res.set_content(std::format("column {} not found", req.get_param_value("measure")), "text/html");
+            res.status = 400;
+            return;
+        }
+    }
+
+    std::string order = req.has_param("order") ? req.get_param_value("order") : "count";
+
+    auto by_value = [&order](const aggregate_row& row) -> double {
+        if (order == "sum") { return static_cast<double>(row.sum); }
+        if (order == "avg") { return static_cast<double>(row.sum) / static_cast<double>(row.count); }
+        if (order == "min") { return static_cast<double>(row.min); }
+        if (order == "max") { return static_cast<double>(row.max); }
+        return static_cast<double>(row.count);
+    };
+
+    if (order != "key" && order != "count" && order != "sum" && order != "avg" && order != "min" && order != "max") {
+        res.set_content(std::format("invalid order {}", order), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    /* Without a measure these are all 0 */
+    if (order != "key" && order != "count" && !query.measure) {
+        res.set_content(std::format("order {} requires a measure", order), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    std::vector<aggregate_row> rows;
+    {
+        auto lock = db->read_lock();
+
+        auto begin = steady_clock::now();
+
+        rows = db->aggregate(query, *range);
+
+        auto end = steady_clock::now();
+
+        spdlog::debug("Aggregated {} groups in {}", rows.size(), end - begin);
+    }
+
+    size_t total_groups = rows.size();
+    size_t row_limit = std::min(*limit, rows.size());
+
+    /* Keys ascending, everything else descending */
+    if (order == "key") {
+        std::ranges::partial_sort(rows, rows.begin() + row_limit, {}, &aggregate_row::key);
+    } else {
+        std::ranges::partial_sort(rows, rows.begin() + row_limit, [&by_value](const aggregate_row& l, const aggregate_row& r) {
+            double lv = by_value(l);
+            double rv = by_value(r);
+            return (lv != rv) ? (lv > rv) : (l.key < r.key);
+        });
+    }
+
+    rows.resize(row_limit);
+
+    auto groups_array = inja::json::array();
+    for (const aggregate_row& row : rows) {
+        auto key = inja::json::array();
+        for (size_t part = 0; part < query.groups.size(); ++part) {
+            key.push_back(aggregate_key_json(query.groups[part].column, row.key[part]));
+        }
+
+        inja::json group = { { "key", key }, { "count", row.count } };
+        if (query.measure) {
+            group["sum"] = row.sum;
+            group["min"] = row.min;
+            group["max"] = row.max;
+            group["avg"] = static_cast<double>(row.sum) / static_cast<double>(row.count);
+        }
+
+        groups_array.push_back(group);
+    }
+
+    auto groups_by = inja::json::array();
+    for (const group_by& group : query.groups) {
+        groups_by.push_back({ { "column", magic_enum::enum_name(group.column) }, { "bucket", group.bucket } });
+    }
+
+    inja::json data;
+    data["group_by"] = groups_by;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["total_groups"] = total_groups;
+    data["groups"] = groups_array;
+
+    if (query.measure) {
+        data["measure"] = magic_enum::enum_name(*query.measure);
+    }
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::cache(const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    auto counters = db->cache_stats();
+
+    inja::json data;
+    data["hits"] = counters.hits;
+    data["misses"] = counters.misses;
+    data["evictions"] = counters.evictions;
+    data["entries"] = counters.entries;
+    data["bytes"] = counters.bytes;
+    data["budget"] = counters.budget;
+
+    auto pages = _pages.stats();
+    uint64_t page_requests = pages.hits + pages.misses;
+
+    data["pages"] = {
+        { "hits", pages.hits },
+        { "misses", pages.misses },
+        { "hit_rate", page_requests > 0 ? static_cast<double>(pages.hits) / static_cast<double>(page_requests) : 0. },
+        { "not_modified", pages.not_modified },
+        { "invalidations", pages.invalidations },
+        { "evictions", pages.evictions },
+        { "entries", pages.entries },
+        { "bytes", pages.bytes },
+        { "budget", pages.budget },
+    };
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::tag_rank(const std::string& name, const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto lock = db->read_lock();
+
+    auto tag = db->find_tag(name);
+    if (tag) {
+        for (tag_type type : magic_enum::enum_values<tag_type>()) {
+            auto ranking = db->tag_rankings(type, *range);
+            if (auto rank = ranking->rank(*tag)) {
+                inja::json data;
+                data["tag"] = name;
+                data["tag_type"] = magic_enum::enum_name(type);
+                data["rank"] = *rank + 1;
+                data["count"] = ranking->page(*rank, 1).front().count;
+                data["total_count"] = ranking->size();
+                data["first_year"] = range->first;
+                data["last_year"] = range->last;
+
+                res.set_content(data.dump(), "application/json");
+                return;
+            }
+        }
+    }
+
+    res.set_content(std::format("tag {} not found", name), "text/html");
+    res.status = 404;
+}
+
+void web_server::related_tags(const std::string& name, const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    static constexpr size_t default_limit = 25;
+    static constexpr size_t max_limit = 1000;
+
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    /* A single category, or all of them */
+    std::vector<tag_type> types;
+    if (req.has_param("category")) {
+        std::string category = req.get_param_value("category");
+        auto type = magic_enum::enum_cast<tag_type>(category);
+        if (!type.has_value()) {
+            res.set_content(std::format("category {} not found", category), "text/html");
+            res.status = 404;
+            return;
+        }
+
+        types.push_back(type.value());
+    } else {
+        auto values = magic_enum::enum_values<tag_type>();
+        types.assign(values.begin(), values.end());
+    }
+
+    auto lock = db->read_lock();
+
+    auto tag = db->find_tag(name);
+    if (!tag) {
+        res.set_content(std::format("tag {} not found", name), "text/html");
+        res.status = 404;
+        return;
+    }
+
+    auto begin = steady_clock::now();
+
+    inja::json related;
+    for (tag_type type : types) {
+        auto tags_array = inja::json::array();
+        for (const auto& related_tag : db->related_tags(*tag, type, *range, *limit)) {
+            tags_array.push_back({ { "tag", db->tag_name(related_tag.tag) }, { "count", related_tag.count } });
+        }
+
+        related[magic_enum::enum_name(type)] = tags_array;
+    }
+
+    auto end = steady_clock::now();
+
+    spdlog::debug("Related tags of {} in {}", name, end - begin);
+
+    inja::json data;
+    data["tag"] = name;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["related"] = related;
+
+    /* False if counts of rare pairs are low, see database_set::related_tags_exact */
+    data["exact"] = db->related_tags_exact(*tag, *range);
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::search(const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    static constexpr size_t default_limit = 10;
+    static constexpr size_t max_limit = 1000;
+
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
+    std::string q = req.get_param_value("q");
+
+    tag_query query;
+    try {
+        query = tag_query::parse(q);
+    } catch (const std::invalid_argument& e) {
+        res.set_content(e.what(), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto lock = db->read_lock();
+
+    auto begin = steady_clock::now();
+
+    search_result result = db->search(query, *range, *limit);
+
+    auto end = steady_clock::now();
+
+    spdlog::debug("Searched {} in {}", q, end - begin);
+
+    auto by_count = [](const auto& l, const auto& r) {
+        return l.second > r.second || (l.second == r.second && l.first < r.first);
+    };
+
+    std::vector<std::pair<int32_t, int32_t>> top_users;
+    for (const auto& [user_id, posts] : result.users) {
+        top_users.emplace_back(user_id, posts);
+    }
+
+    size_t user_limit = std::min(*limit, top_users.size());
+    std::ranges::partial_sort(top_users, top_users.begin() + user_limit, by_count);
+    top_users.resize(user_limit);
+
+    auto users_array = inja::json::array();
+    for (const auto& [user_id, posts] : top_users) {
+        users_array.push_back({ { "user_id", user_id }, { "posts", posts } });
+    }
+
+    inja::json categories;
+    for (tag_type type : magic_enum::enum_values<tag_type>()) {
+        std::vector<std::pair<tag_id, int32_t>> top_tags;
+        for (const auto& [tag, count] : result.tag_counts[type]) {
+            top_tags.emplace_back(tag, count);
+        }
+
+        size_t tag_limit = std::min(*limit, top_tags.size());
+        std::ranges::partial_sort(top_tags, top_tags.begin() + tag_limit, by_count);
+        top_tags.resize(tag_limit);
+
+        auto tags_array = inja::json::array();
+        for (const auto& [tag, count] : top_tags) {
+            tags_array.push_back({ { "tag", db->tag_name(tag) }, { "count", count } });
+        }
+
+        categories[magic_enum::enum_name(type)] = {
+            { "unique_tags", result.tag_counts[type].size() },
+            { "top_tags", tags_array },
+        };
+    }
+
+    inja::json data;
+    data["query"] = q;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
+    data["posts"] = result.posts;
+    data["post_ids"] = result.post_ids;
+    data["users"] = result.users.size();
+    data["top_users"] = users_array;
+    data["categories"] = categories;
+
+    res.set_content(data.dump(), "application/json");
+}
+
+void web_server::memory(const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
+    std::vector<memory_entry> report;
+    {
+        auto lock = db->read_lock();
+        report = db->memory_report();
+    }
+
+    /* Templates are only counted by their source, the parsed form is about the same size */
+    memory_footprint templates { .owned = node_container_bytes(_template_cache) + node_container_bytes(_template_paths) };
+    for (const auto& [id, tmpl] : _template_cache) {
+        templates.owned += tmpl.content.capacity();
+    }
+
+    report.push_back({ "template_cache", templates });
+    report.push_back({ "page_cache", _pages.footprint() });
+
+    memory_footprint static_files;
+    {
+        std::scoped_lock lock { _static_lock };
+        static_files.owned = node_container_bytes(_static_files);
+        for (const auto& [path, file] : _static_files) {
+            static_files.owned += path.capacity() + sizeof(encoded_bodies) + file.encoded->memory_usage();
+        }
+    }
+
+    report.push_back({ "static_compression", static_files });
+    report.push_back({ "trending_tags", { .owned = _trending.memory_usage() } });
+
+    memory_footprint total;
+    auto entries = inja::json::array();
+    for (const auto& [name, footprint] : report) {
+        entries.push_back({ { "name", name }, { "owned", footprint.owned }, { "mapped", footprint.mapped } });
+        total += footprint;
+    }
+
+    inja::json data;
+    data["entries"] = entries;
+    data["owned"] = total.owned;
+    data["mapped"] = total.mapped;
+    data["resident"] = resident_memory();
+
+    res.set_content(data.dump(), "application/json");
+}
+
 void web_server::tags(const std::string& category, const httplib::Request& req, httplib::Response& res) {
+    auto db = _data.current();
+
     auto type = magic_enum::enum_cast<tag_type>(category);
     if (!type.has_value()) {
         res.set_content(std::format("category {} not found", category), "text/html");
@@ -124,24 +919,56 @@ void web_server::tags(const std::string& category, const httplib::Request& req,
         return;
     }
 
+    static constexpr size_t default_limit = 25;
+    static constexpr size_t max_limit = 1000;
+
+    auto offset = numeric_param<size_t>(req, "offset", 0);
+    auto limit = numeric_param<size_t>(req, "limit", default_limit);
+    if (!offset || !limit || *limit == 0 || *limit > max_limit) {
+        res.set_content(std::format("invalid offset or limit (at most {})", max_limit), "text/html");
+        res.status = 400;
+        return;
+    }
+
+    auto range = _year_range(*db, req);
+    if (!range) {
+        res.set_content("invalid year range", "text/html");
+        res.status = 400;
+        return;
+    }
+
     const auto& tmpl = _ensure_template(template_id::tags);
 
     inja::json data;
     data["tag_type"] = magic_enum::enum_name(type.value());
 
-    static constexpr size_t tag_count = 25;
+    auto tags_array = inja::json::array();
 
-    data["tag_count"] = tag_count;
+    data["first_year"] = range->first;
+    data["last_year"] = range->last;
 
-    auto tags_array = inja::json::array();
+    auto lock = db->read_lock();
+    auto ranking = db->tag_rankings(type.value(), *range);
 
-    const auto& counts = _db.tag_rankings(type.value());
+    /* Constant time for any offset */
+    auto page = ranking->page(*offset, *limit);
 
-    data["total_count"] = counts.size();
-    
-    for (const auto& tag : counts | std::views::take(tag_count)) {
+    data["total_count"] = ranking->size();
+    data["tag_count"] = page.size();
+    data["offset"] = *offset;
+    data["limit"] = *limit;
+    data["first_rank"] = *offset + 1;
 
-        tags_array.push_back({ { "tag", tag.first }, { "count", tag.second } });
+    if (*offset > 0) {
+        data["prev_offset"] = *offset - std::min(*offset, *limit);
+    }
+
+    if (*offset + page.size() < ranking->size()) {
+        data["next_offset"] = *offset + page.size();
+    }
+
+    for (const auto& tag : page) {
+        tags_array.push_back({ { "tag", db->tag_name(tag.tag) }, { "count", tag.count } });
     }
 
     data["tags"] = tags_array;
@@ -150,6 +977,202 @@ void web_server::tags(const std::string& category, const httplib::Request& req,
 }
 
 
+std::optional<year_range> web_server::_year_range(const database_set& db, const httplib::Request& req) const {
+    year_range all = db.all_years();
+
+    std::optional<year_range> res;
+    if (req.has_param("year")) {
+        auto year = numeric_param<int>(req, "year", 0);
+        if (year) {
+            res = year_range { *year, *year };
+        }
+    } else {
+        auto first = numeric_param<int>(req, "from", all.first);
+        auto last = numeric_param<int>(req, "to", all.last);
+        if (first && last) {
+            res = year_range { *first, *last };
+        }
+    }
+
+    if (!res || !db.contains(*res)) {
+        return std::nullopt;
+    }
+
+    /* from=-5 and from=-6 are the same years, and should be cached as such */
+    return db.clamp(*res);
+}
+
+void web_server::_cached_page(template_id id, std::initializer_list<std::string_view> params, const httplib::Request& req, httplib::Response& res,
+    const std::function<void()>& render, std::chrono::steady_clock::duration max_age) {
+    auto db = _data.current();
+
+    /* Taken before rendering, so a page is never cached as newer than what it was rendered from */
+    uint64_t version = db->version();
+    uint64_t generation = _pages.generation();
+
+    /* Normalized, so from=-5 and from=-6 or top=010 and top=10 are the same page */
+    auto range = _year_range(*db, req);
+    if (!range) {
+        render();
+        return;
+    }
+
+    std::string key = std::format("{}\n{}-{}", req.path, range->first, range->last);
+    for (std::string_view name : params) {
+        std::string param { name };
+        if (!req.has_param(param)) {
+            continue;
+        }
+
+        auto value = numeric_param<int64_t>(req, param, 0);
+        if (!value) {
+            render();
+            return;
+        }
+
+        key += std::format("\n{}={}", name, *value);
+    }
+
+    auto page = _pages.find(key, version, max_age);
+    bool cached = true;
+    if (!page) {
+        render();
+
+        /* Errors aren't cached, the status is still unset (-1) when the handler succeeded */
+        if (res.status >= 300) {
+            return;
+        }
+
+        std::tie(page, cached) = _pages.insert(std::move(key), version, generation, static_cast<size_t>(id), std::move(res.body), res.get_header_value("Content-Type"));
+    }
+
+    /* Cached by clients, but checked with us every time */
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("Vary", "Accept-Encoding");
+
+    /* Served uncompressed until it's compressed in the background, only cached pages are compressed */
+    std::shared_ptr<const encoded_body> encoded;
+    std::string accept_encoding = req.get_header_value("Accept-Encoding");
+    if (!accept_encoding.empty() && page->body.size() >= min_compressed_size && compressible_type(page->content_type)) {
+        encoded = page->encoded.select(accept_encoding);
+
+        if (!encoded && cached) {
+            _queue_compression(page->encoded, [weak_page = std::weak_ptr { page }] {
+                if (auto page = weak_page.lock()) {
+                    page->encoded.encode(page->body, page->etag);
+                }
+            });
+        }
+    }
+
+    const std::string& etag = encoded ? encoded->etag : page->etag;
+    res.set_header("ETag", etag);
+
+    if (req.has_header("If-None-Match") && response_cache::matches(req.get_header_value("If-None-Match"), etag)) {
+        _pages.count_not_modified();
+
+        res.headers.erase("Content-Type");
+        res.body.clear();
+        res.status = 304;
+        return;
+    }
+
+    if (encoded) {
+        res.set_content(encoded->body, page->content_type);
+        res.set_header("Content-Encoding", std::string { magic_enum::enum_name(encoded->encoding) });
+    } else {
+        res.set_content(page->body, page->content_type);
+    }
+}
+
+void web_server::_queue_compression(encoded_bodies& encoded, std::function<void()> compress) {
+    if (_compressions_pending.fetch_add(1, std::memory_order_relaxed) >= max_pending_compressions || !encoded.try_queue()) {
+        _compressions_pending.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    _compression.submit([this, compress = std::move(compress)] {
+        compress();
+        _compressions_pending.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
+bool web_server::_compressed_static(const httplib::Request& req, httplib::Response& res) {
+    std::string accept_encoding = req.get_header_value("Accept-Encoding");
+    if (accept_encoding.empty()) {
+        return false;
+    }
+
+    /* Anything outside of the static directory is left to the mount point to refuse */
+    auto path = (_static_path / std::string_view { req.path }.substr(std::string_view { "/static/" }.size())).lexically_normal();
+    auto relative = path.lexically_relative(_static_path);
+    if (relative.empty() || *relative.begin() == "..") {
+        return false;
+    }
+
+    std::string_view content_type = compressible_static_type(path);
+    if (content_type.empty()) {
+        return false;
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        return false;
+    }
+
+    auto size = std::filesystem::file_size(path, ec);
+    auto modified = std::filesystem::last_write_time(path, ec);
+    if (ec || size < min_compressed_size) {
+        return false;
+    }
+
+    std::shared_ptr<encoded_bodies> encoded;
+    {
+        std::scoped_lock lock { _static_lock };
+
+        auto& file = _static_files[relative.generic_string()];
+        if (!file.encoded || file.modified != modified || file.size != size) {
+            file = { .modified = modified, .size = size, .encoded = std::make_shared<encoded_bodies>() };
+        }
+
+        encoded = file.encoded;
+    }
+
+    _queue_compression(*encoded, [weak_encoded = std::weak_ptr { encoded }, path] {
+        /* Replaced by a newer version of the file */
+        auto encoded = weak_encoded.lock();
+        if (!encoded) {
+            return;
+        }
+
+        std::ifstream stream { path, std::ios::binary };
+        std::string body { std::istreambuf_iterator<char> { stream }, {} };
+
+        if (!stream.bad()) {
+            encoded->encode(body, response_cache::make_etag(body));
+        }
+    });
+
+    res.set_header("Vary", "Accept-Encoding");
+
+    auto body = encoded->select(accept_encoding);
+    if (!body) {
+        return false;
+    }
+
+    res.set_header("ETag", body->etag);
+
+    if (req.has_header("If-None-Match") && response_cache::matches(req.get_header_value("If-None-Match"), body->etag)) {
+        res.status = 304;
+        return true;
+    }
+
+    res.set_content(body->body, std::string { content_type });
+    res.set_header("Content-Encoding", std::string { magic_enum::enum_name(body->encoding) });
+
+    return true;
+}
+
 const inja::Template& web_server::_ensure_template(template_id id) {
     /* Return a template by it's ID, load it from a file if not already loaded */
     std::string_view file = template_filename(id);
@@ -176,6 +1199,7 @@ void web_server::handleFileAction(efsw::WatchID watch_id, const std::string& dir
     if (filename == "base.html") {
         spdlog::info("Purging template cache");
         _template_cache.clear();
+        _pages.clear();
         return;
     }
 
@@ -191,6 +1215,7 @@ void web_server::handleFileAction(efsw::WatchID watch_id, const std::string& dir
 
                 /* Reload by just purging the cached template, this avoid reloading unnecessarily */
                 _template_cache.erase(it->second);
+                _pages.invalidate(static_cast<size_t>(it->second));
             }
         }
     } catch (const std::filesystem::filesystem_error& e) {
@@ -1,6 +1,13 @@
 #ifndef WEB_SERVER_H
 #define WEB_SERVER_H
 
+/* Pages and static files are compressed ahead of time by web_server, and httplib doesn't check for
+ * Content-Encoding before compressing text bodies itself. Use a build of it without compression.
+ */
+#if defined(CPPHTTPLIB_ZLIB_SUPPORT) || defined(CPPHTTPLIB_BROTLI_SUPPORT)
+#error "httplib must be built without CPPHTTPLIB_ZLIB_SUPPORT and CPPHTTPLIB_BROTLI_SUPPORT"
+#endif
+
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 
@@ -8,10 +15,23 @@
 
 #include <efsw/efsw.hpp>
 
+#include "compression.h"
+#include "response_cache.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string_view>
 #include <unordered_map>
 
 class danbooru;
-class database;
+class database_set;
+class live_dataset;
+class trending_tags;
+struct year_range;
 class web_server : private efsw::FileWatchListener {
     httplib::Server _server;
     std::filesystem::path _template_path;
@@ -21,7 +41,8 @@ class web_server : private efsw::FileWatchListener {
     efsw::WatchID _watch_id;
 
     danbooru& _danbooru;
-    database& _db;
+    live_dataset& _data;
+    trending_tags& _trending;
 
     enum class template_id {
         user,
@@ -31,16 +52,53 @@ class web_server : private efsw::FileWatchListener {
     std::unordered_map<template_id, inja::Template> _template_cache;
     std::unordered_map<std::filesystem::path, template_id> _template_paths;
 
+    /* Rendered pages, by the template they're rendered from */
+    response_cache _pages;
+
+    /* Compressed static files by path relative to _static_path, redone when a file changes */
+    struct static_file {
+        std::filesystem::file_time_type modified;
+        uintmax_t size;
+        std::shared_ptr<encoded_bodies> encoded;
+    };
+
+    std::mutex _static_lock;
+    std::unordered_map<std::string, static_file> _static_files;
+
+    /* Compresses pages and static files in the background, so requests never wait for it. Tasks only
+     * hold weak references, what's dropped from the caches in the meantime is skipped.
+     */
+    std::atomic<size_t> _compressions_pending { 0 };
+    thread_pool _compression { 1 };
+
     public:
+    static constexpr size_t default_page_cache_budget = size_t { 64 } << 20;
+
+    /* User pages include the user's name, which is looked up only when rendering */
+    static constexpr std::chrono::minutes user_page_max_age { 15 };
+
+    /* Beyond this, bodies are served uncompressed and queued again by a later request */
+    static constexpr size_t max_pending_compressions = 64;
+
     virtual ~web_server();
 
-    explicit web_server(danbooru& danbooru, database& db, const std::string& template_path = "./html/", const std::string& static_path = "./static/");
+    explicit web_server(danbooru& danbooru, live_dataset& data, trending_tags& trending, size_t page_cache_budget = default_page_cache_budget, const std::string& template_path = "./html/", const std::string& static_path = "./static/");
 
     void listen(const std::string& addr, uint16_t port);
 
     protected:
     virtual void user(int32_t id, const httplib::Request& req, httplib::Response& res);
     virtual void tags(const std::string& category, const httplib::Request& req, httplib::Response& res);
+    virtual void top_users(const std::string& metric_name, const httplib::Request& req, httplib::Response& res);
+    virtual void distinct_tags(const std::string& category, const httplib::Request& req, httplib::Response& res);
+    virtual void distinct_users(const httplib::Request& req, httplib::Response& res);
+    virtual void trending(const std::string& window_name, const httplib::Request& req, httplib::Response& res);
+    virtual void aggregate(const httplib::Request& req, httplib::Response& res);
+    virtual void tag_rank(const std::string& name, const httplib::Request& req, httplib::Response& res);
+    virtual void related_tags(const std::string& name, const httplib::Request& req, httplib::Response& res);
+    virtual void search(const httplib::Request& req, httplib::Response& res);
+    virtual void cache(const httplib::Request& req, httplib::Response& res);
+    virtual void memory(const httplib::Request& req, httplib::Response& res);
 
     private:
     [[nodiscard]] static constexpr std::string_view template_filename(template_id id) {
@@ -52,6 +110,22 @@ class web_server : private efsw::FileWatchListener {
         }
     }
 
+    /* Years selected by the year, or from and to parameters, all years by default */
+    [[nodiscard]] std::optional<year_range> _year_range(const database_set& db, const httplib::Request& req) const;
+
+    /* Serve a page from _pages with its ETag, or render it and cache it if rendering succeeds.
+     * Pages are cached by path, year range and the numeric params the page reads, anything else
+     * in the query string is ignored. Invalid params are left for render to report.
+     */
+    void _cached_page(template_id id, std::initializer_list<std::string_view> params, const httplib::Request& req, httplib::Response& res,
+        const std::function<void()>& render, std::chrono::steady_clock::duration max_age = std::chrono::steady_clock::duration::max());
+
+    /* Queue compress on _compression for encoded, unless it's queued already or the queue is full */
+    void _queue_compression(encoded_bodies& encoded, std::function<void()> compress);
+
+    /* Serve a static file compressed, if the client accepts it and it's compressed already */
+    [[nodiscard]] bool _compressed_static(const httplib::Request& req, httplib::Response& res);
+
     [[nodiscard]] const inja::Template& _ensure_template(template_id id);
     [[nodiscard]] std::string _make_template_path(template_id id) const;
 
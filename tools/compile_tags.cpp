@@ -0,0 +1,79 @@
+/*
+ * Compiles the tags table written by fetch_tags into a tag catalog: a minimal perfect hash of
+ * every tag name plus its ID, category and post count, to be passed as TAG_CATALOG.
+ *
+ * Usage: compile_tags <tags> <catalog>
+ **/
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <print>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "string_arena.h"
+#include "tag_catalog.h"
+
+using std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::println(std::cerr, "Usage:\n    {} <tags> <catalog>", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path tags_path = argv[1];
+    std::filesystem::path catalog_path = argv[2];
+
+    if (!exists(tags_path)) {
+        std::println(std::cerr, "\"{}\" does not exist", tags_path.string());
+        return EXIT_FAILURE;
+    }
+
+    try {
+        auto begin = steady_clock::now();
+
+        string_arena names;
+        std::vector<catalog_tag> tags;
+
+        SQLite::Database db { tags_path.string(), SQLite::OPEN_READONLY };
+        SQLite::Statement query { db, "SELECT id, name, post_count, category FROM tags" };
+        while (query.executeStep()) {
+            tags.push_back(catalog_tag {
+                .id = query.getColumn(0).getInt(),
+                .name = names.store(query.getColumn(1).getText()),
+                .post_count = query.getColumn(2).getInt(),
+                .category = static_cast<uint8_t>(query.getColumn(3).getInt()),
+            });
+        }
+
+        auto end = steady_clock::now();
+        std::println(std::cerr, "Read {} tags in {}", tags.size(), std::chrono::duration_cast<std::chrono::milliseconds>(end - begin));
+
+        begin = steady_clock::now();
+
+        tag_catalog::write(catalog_path.string(), tags);
+
+        end = steady_clock::now();
+        std::println(std::cerr, "Compiled into {} ({} bytes) in {}", catalog_path.string(), file_size(catalog_path), std::chrono::duration_cast<std::chrono::milliseconds>(end - begin));
+
+        /* Make sure it reads back */
+        tag_catalog catalog { catalog_path.string() };
+        for (const catalog_tag& tag : tags) {
+            auto slot = catalog.find(tag.name);
+            if (!slot || catalog.id(*slot) != tag.id) {
+                throw std::runtime_error { std::format("Tag {} was not found in the catalog", tag.name) };
+            }
+        }
+    } catch (const std::exception& e) {
+        std::println(std::cerr, "Failed to compile tags: {}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
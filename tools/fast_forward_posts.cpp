@@ -15,6 +15,9 @@
 
 #include <tqdm/tqdm.h>
 
+#include "string_arena.h"
+#include "tag_tokenizer.h"
+
 #include <SQLiteCpp/SQLiteCpp.h>
 
 template <> struct std::formatter<std::chrono::nanoseconds> {
@@ -80,7 +83,8 @@ struct post {
 
     uint32_t parent_id;
     
-    std::string source;
+    /* Strings are stored in the arena of the posts_database */
+    std::string_view source;
     
     std::optional<std::array<char, 32>> md5;
     std::array<char, 4> file_ext;
@@ -104,11 +108,11 @@ struct post {
     bool is_deleted;
     bool is_banned;
 
-    std::optional<std::string> last_commented_at;
-    std::optional<std::string> last_comment_bumped_at;
-    std::optional<std::string> last_noted_at;
-    std::string created_at;
-    std::string updated_at;
+    std::optional<std::string_view> last_commented_at;
+    std::optional<std::string_view> last_comment_bumped_at;
+    std::optional<std::string_view> last_noted_at;
+    std::string_view created_at;
+    std::string_view updated_at;
 };
 
 template <size_t N>
@@ -129,11 +133,11 @@ std::optional<std::array<char, N>> optional_string_as_array(const SQLite::Column
     }
 }
 
-[[nodiscard]] static std::optional<std::string> optional_string(const SQLite::Column& col) {
+[[nodiscard]] static std::optional<std::string_view> optional_string(string_arena& arena, const SQLite::Column& col) {
     if (col.isNull()) {
         return {};
     } else {
-        return col.getString();
+        return arena.store(col.getText());
     }
 }
 
@@ -171,7 +175,10 @@ struct posts_database {
         tag_type type;
     };
 
-    std::unordered_map<std::string, tag, string_hasher, range_eq> tags;
+    /* Owns all text of the tags and posts, freed at once */
+    string_arena strings;
+
+    std::unordered_map<std::string_view, tag, string_hasher, range_eq> tags;
     std::vector<post> posts;
     size_t total_tags = 0;
 
@@ -210,7 +217,7 @@ struct posts_database {
                 .tag_string_meta        = split_tags(query.getColumn(7).getText(), (tag_count_meta = query.getColumn(23))),
                 .rating                 = *query.getColumn(8).getText(),
                 .parent_id              = query.getColumn(9),
-                .source                 = query.getColumn(10).getString(),
+                .source                 = strings.store(query.getColumn(10).getText()),
                 .md5                    = optional_string_as_array<32>(query.getColumn(11)),
                 .file_ext               = string_as_array<4>(query.getColumn(12).getText()),
                 .file_size              = query.getColumn(13),
@@ -229,11 +236,11 @@ struct posts_database {
                 .down_score             = query.getColumn(26),
                 .is_deleted             = query.getColumn(27).getUInt() ? true : false,
                 .is_banned              = query.getColumn(28).getUInt() ? true : false,
-                .last_commented_at      = optional_string(query.getColumn(29)),
-                .last_comment_bumped_at = optional_string(query.getColumn(30)),
-                .last_noted_at          = optional_string(query.getColumn(31)),
-                .created_at             = query.getColumn(32).getString(),
-                .updated_at             = query.getColumn(33).getString(),
+                .last_commented_at      = optional_string(strings, query.getColumn(29)),
+                .last_comment_bumped_at = optional_string(strings, query.getColumn(30)),
+                .last_noted_at          = optional_string(strings, query.getColumn(31)),
+                .created_at             = strings.store(query.getColumn(32).getText()),
+                .updated_at             = strings.store(query.getColumn(33).getText()),
             };
 
             posts.emplace_back(std::move(post));
@@ -277,15 +284,16 @@ struct posts_database {
 
     private:
     uint32_t _current_tag = 0;
+    tag_tokenizer _tokenizer;
 
     [[nodiscard]] tag_set split_tags(std::string_view string, /*tag_type type, */ uint16_t reserve = 0) {
         tag_set result;
         result.reserve(reserve);
 
-        for (auto tag : string | std::views::split(' ')) {
+        for (std::string_view tag : _tokenizer.split(string)) {
             auto it = tags.find(tag);
             if (it == tags.end()) {
-                tags.emplace(std::string { tag.begin(), tag.end() }, _current_tag);
+                tags.emplace(strings.store(tag), _current_tag);
 
                 /* First occurence of this tag, so it can never be already present */
                 result.push_back(_current_tag);
@@ -370,6 +378,7 @@ void process_posts(const std::filesystem::path& posts_path, const std::filesyste
     std::println(std::cerr, "    {}/s", tags_per_second);
     std::println(std::cerr, "  {} total tags", posts.total_tags);
     std::println(std::cerr, "    {}/s", total_tags_per_second);
+    std::println(std::cerr, "  {} of text", format_bytes { posts.strings.memory_usage() });
 
     std::string s;
     std::cin >> s;
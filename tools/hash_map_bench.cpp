@@ -0,0 +1,247 @@
+/*
+ * Compares std::map, std::unordered_map and flat_hash_map on the workloads DanbooruStats
+ * uses maps for, on synthetic data shaped like a year of posts:
+ * - Counting tag IDs (tag_count_map)
+ * - Grouping posts by uploader (user_post_map)
+ * - Interning tag names (tag_dictionary)
+ *
+ * Usage: hash_map_bench [scale]
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <map>
+#include <new>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "flat_hash_map.h"
+
+using std::chrono::steady_clock;
+
+/* Track live heap memory, with a header in front of every allocation to remember it's size */
+static size_t live_bytes = 0;
+
+static constexpr size_t header_size = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    auto ptr = static_cast<std::byte*>(std::malloc(size + header_size));
+    if (!ptr) {
+        throw std::bad_alloc {};
+    }
+
+    *reinterpret_cast<size_t*>(ptr) = size;
+    live_bytes += size;
+
+    return ptr + header_size;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr) {
+        auto base = static_cast<std::byte*>(ptr) - header_size;
+        live_bytes -= *reinterpret_cast<size_t*>(base);
+        std::free(base);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+template <> struct std::formatter<std::chrono::nanoseconds> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const std::chrono::nanoseconds& ns, format_context& ctx) const {
+        if (ns < std::chrono::microseconds(1)) {
+            return std::format_to(ctx.out(), "{} ns", ns.count());
+        } else if (ns < std::chrono::milliseconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} us", ns.count() / 1e3);
+        } else if (ns < std::chrono::seconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} ms", ns.count() / 1e6);
+        }
+
+        return std::format_to(ctx.out(), "{:.3f} s", ns.count() / 1e9);
+    }
+};
+
+struct format_bytes {
+    format_bytes(size_t count) : count { count } { }
+    size_t count;
+};
+
+template <> struct std::formatter<format_bytes> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const format_bytes& bytes, format_context& ctx) const {
+        if (bytes.count < 1024) {
+            return std::format_to(ctx.out(), "{} bytes", bytes.count);
+        } else if (bytes.count < size_t { 1024 } * 1024) {
+            return std::format_to(ctx.out(), "{:.3f} KiB", bytes.count / 1024.);
+        } else if (bytes.count < size_t { 1024 } * 1024 * 1024) {
+            return std::format_to(ctx.out(), "{:.3f} MiB", bytes.count / 1024. / 1024.);
+        }
+
+        return std::format_to(ctx.out(), "{:.3f} GiB", bytes.count / 1024. / 1024. / 1024.);
+    }
+};
+
+/* Zipf-distributed values in [0, count), tag and uploader popularity both look like this */
+static std::vector<uint32_t> zipf(size_t samples, size_t count, double exponent, uint32_t seed) {
+    std::vector<double> weights(count);
+    for (size_t i = 0; i < count; ++i) {
+        weights[i] = 1. / std::pow(static_cast<double>(i + 1), exponent);
+    }
+
+    std::mt19937 rng { seed };
+    std::discrete_distribution<uint32_t> dist { weights.begin(), weights.end() };
+
+    /* Popular values shouldn't all have low IDs */
+    std::vector<uint32_t> permutation(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        permutation[i] = i;
+    }
+
+    std::ranges::shuffle(permutation, rng);
+
+    std::vector<uint32_t> res(samples);
+    for (uint32_t& value : res) {
+        value = permutation[dist(rng)];
+    }
+
+    return res;
+}
+
+struct result {
+    std::chrono::nanoseconds time;
+    size_t bytes;
+};
+
+/* Best of a few runs, so allocator warmup doesn't count against whoever runs first */
+template <typename F>
+static result measure(F&& body) {
+    static constexpr int runs = 3;
+
+    result res { std::chrono::nanoseconds::max(), 0 };
+    for (int i = 0; i < runs; ++i) {
+        size_t before = live_bytes;
+        auto begin = steady_clock::now();
+
+        res.bytes = body(before);
+
+        auto end = steady_clock::now();
+
+        res.time = std::min<std::chrono::nanoseconds>(res.time, end - begin);
+    }
+
+    return res;
+}
+
+template <typename Map>
+static result count_tags(std::span<const uint32_t> tags) {
+    return measure([tags](size_t before) {
+        Map counts;
+        for (uint32_t tag : tags) {
+            auto it = counts.find(tag);
+            if (it == counts.end()) {
+                counts.emplace(tag, 1);
+            } else {
+                it->second += 1;
+            }
+        }
+
+        return live_bytes - before;
+    });
+}
+
+template <typename Map>
+static result group_posts(std::span<const uint32_t> uploaders) {
+    return measure([uploaders](size_t before) {
+        Map user_posts;
+        for (uint32_t row = 0; row < uploaders.size(); ++row) {
+            user_posts[static_cast<int32_t>(uploaders[row])].push_back(row);
+        }
+
+        return live_bytes - before;
+    });
+}
+
+template <typename Map>
+static result intern_tags(std::span<const std::string> names, std::span<const uint32_t> lookups) {
+    return measure([names, lookups](size_t before) {
+        Map ids;
+        uint64_t checksum = 0;
+        for (uint32_t i : lookups) {
+            std::string_view name = names[i];
+            auto it = ids.find(name);
+            if (it == ids.end()) {
+                it = ids.emplace(name, static_cast<uint32_t>(ids.size())).first;
+            }
+
+            checksum += it->second;
+        }
+
+        if (checksum == 0) {
+            std::println(std::cerr, "Unexpected checksum");
+        }
+
+        return live_bytes - before;
+    });
+}
+
+static void print_results(std::string_view name, const result& map, const result& unordered, const result& flat) {
+    std::println("{}:", name);
+    std::println("  {:<18} {:>12} {:>14}", "std::map", std::format("{}", map.time), std::format("{}", format_bytes { map.bytes }));
+    std::println("  {:<18} {:>12} {:>14}", "std::unordered_map", std::format("{}", unordered.time), std::format("{}", format_bytes { unordered.bytes }));
+    std::println("  {:<18} {:>12} {:>14}", "flat_hash_map", std::format("{}", flat.time), std::format("{}", format_bytes { flat.bytes }));
+}
+
+int main(int argc, char** argv) {
+    double scale = (argc > 1) ? std::stod(argv[1]) : 1.;
+
+    /* Roughly a year of posts: ~1.2M posts with ~35 tags each, ~500k unique tags, ~40k uploaders */
+    size_t posts = static_cast<size_t>(1'200'000 * scale);
+    size_t tag_occurences = posts * 35;
+    size_t unique_tags = static_cast<size_t>(500'000 * scale);
+    size_t uploaders = static_cast<size_t>(40'000 * scale);
+
+    std::print(std::cerr, "Generating data... ");
+    auto tags = zipf(tag_occurences, unique_tags, 1.0, 1);
+    auto post_uploaders = zipf(posts, uploaders, 1.1, 2);
+
+    std::vector<std::string> names(unique_tags);
+    for (size_t i = 0; i < unique_tags; ++i) {
+        names[i] = std::format("tag_name_{}_{}", i * 2654435761u % 100000, i);
+    }
+
+    std::println(std::cerr, "done");
+
+    std::println("{} tag occurences of {} tags, {} posts by {} uploaders\n", tag_occurences, unique_tags, posts, uploaders);
+
+    print_results("Count tags",
+        count_tags<std::map<uint32_t, int32_t>>(tags),
+        count_tags<std::unordered_map<uint32_t, int32_t>>(tags),
+        count_tags<flat_hash_map<uint32_t, int32_t>>(tags));
+
+    print_results("Group posts by uploader",
+        group_posts<std::map<int32_t, std::vector<uint32_t>>>(post_uploaders),
+        group_posts<std::unordered_map<int32_t, std::vector<uint32_t>>>(post_uploaders),
+        group_posts<flat_hash_map<int32_t, std::vector<uint32_t>>>(post_uploaders));
+
+    print_results("Intern tag names",
+        intern_tags<std::map<std::string_view, uint32_t>>(names, tags),
+        intern_tags<std::unordered_map<std::string_view, uint32_t>>(names, tags),
+        intern_tags<flat_hash_map<std::string_view, uint32_t>>(names, tags));
+}
@@ -0,0 +1,174 @@
+/*
+ * Compares ways of reading the posts table the way post_loader does, on a single connection:
+ * - select * through SQLiteCpp, as used before
+ * - only the needed columns through SQLiteCpp
+ * - only the needed columns with the C API, reading text in place, with bulk scan pragmas
+ *
+ * Every variant splits the tag strings, so the numbers include the work the loader does with them.
+ * Run it twice to compare with a warm page cache.
+ *
+ * Usage: loader_bench <database>
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <string>
+#include <string_view>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <sqlite3.h>
+
+#include "tag_tokenizer.h"
+
+using std::chrono::steady_clock;
+
+template <> struct std::formatter<std::chrono::nanoseconds> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const std::chrono::nanoseconds& ns, format_context& ctx) const {
+        if (ns < std::chrono::microseconds(1)) {
+            return std::format_to(ctx.out(), "{} ns", ns.count());
+        } else if (ns < std::chrono::milliseconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} us", ns.count() / 1e3);
+        } else if (ns < std::chrono::seconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} ms", ns.count() / 1e6);
+        }
+
+        return std::format_to(ctx.out(), "{:.3f} s", ns.count() / 1e9);
+    }
+};
+
+static constexpr std::string_view projected_query =
+    "select id, uploader_id, tag_string_general, tag_string_artist, tag_string_copyright, tag_string_character, tag_string_meta from posts";
+
+struct result {
+    std::chrono::nanoseconds time;
+    size_t posts = 0;
+    size_t tags = 0;
+    size_t bytes = 0;
+    int64_t checksum = 0;
+};
+
+static void count_tags(tag_tokenizer& tokenizer, std::string_view tag_string, result& res) {
+    res.bytes += tag_string.size();
+    res.tags += tokenizer.split(tag_string).size();
+}
+
+static result sqlitecpp_all(const std::string& path) {
+    SQLite::Database db { path, SQLite::OPEN_READONLY };
+    SQLite::Statement query { db, "select * from posts" };
+    tag_tokenizer tokenizer;
+
+    result res;
+    while (query.executeStep()) {
+        res.posts += 1;
+        res.checksum += query.getColumn(0).getInt() + query.getColumn(1).getInt();
+
+        for (int column : { 6, 3, 4, 5, 7 }) {
+            count_tags(tokenizer, query.getColumn(column).getText(), res);
+        }
+    }
+
+    return res;
+}
+
+static result sqlitecpp_projected(const std::string& path) {
+    SQLite::Database db { path, SQLite::OPEN_READONLY };
+    SQLite::Statement query { db, std::string { projected_query } };
+    tag_tokenizer tokenizer;
+
+    result res;
+    while (query.executeStep()) {
+        res.posts += 1;
+        res.checksum += query.getColumn(0).getInt() + query.getColumn(1).getInt();
+
+        for (int column = 2; column < 7; ++column) {
+            count_tags(tokenizer, query.getColumn(column).getText(), res);
+        }
+    }
+
+    return res;
+}
+
+static result raw_projected(const std::string& path) {
+    SQLite::Database db { path, SQLite::OPEN_READONLY };
+    db.exec(std::format("pragma mmap_size = {}", std::filesystem::file_size(path)));
+    db.exec("pragma cache_size = -16384");
+    db.exec("pragma temp_store = memory");
+
+    sqlite3_stmt* raw_stmt = nullptr;
+    if (int ret = sqlite3_prepare_v2(db.getHandle(), projected_query.data(), static_cast<int>(projected_query.size()), &raw_stmt, nullptr); ret != SQLITE_OK) {
+        throw SQLite::Exception { db.getHandle(), ret };
+    }
+
+    std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt { raw_stmt, &sqlite3_finalize };
+    tag_tokenizer tokenizer;
+
+    result res;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        res.posts += 1;
+        res.checksum += sqlite3_column_int(stmt.get(), 0) + sqlite3_column_int(stmt.get(), 1);
+
+        for (int column = 2; column < 7; ++column) {
+            const auto* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), column));
+            count_tags(tokenizer, { text ? text : "", static_cast<size_t>(sqlite3_column_bytes(stmt.get(), column)) }, res);
+        }
+    }
+
+    return res;
+}
+
+/* Best of a few runs */
+template <typename F>
+static result measure(F&& read) {
+    static constexpr int runs = 3;
+
+    result best { std::chrono::nanoseconds::max() };
+    for (int i = 0; i < runs; ++i) {
+        auto begin = steady_clock::now();
+        result res = read();
+        auto end = steady_clock::now();
+
+        res.time = end - begin;
+        if (res.time < best.time) {
+            best = res;
+        }
+    }
+
+    return best;
+}
+
+static void print_result(std::string_view name, const result& res, const result& baseline) {
+    double seconds = std::chrono::duration<double>(res.time).count();
+    std::println("  {:<22} {:>12} {:>10.2f} Mposts/s {:>10.1f} MiB/s {:>6.2f}x", name, std::format("{}", res.time),
+        res.posts / seconds / 1e6, res.bytes / seconds / 1024. / 1024.,
+        std::chrono::duration<double>(baseline.time).count() / seconds);
+
+    if (res.checksum != baseline.checksum || res.tags != baseline.tags) {
+        std::println(std::cerr, "  {} read different posts", name);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::println(std::cerr, "Usage: {} <database>", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string path = argv[1];
+
+    result all = measure([&] { return sqlitecpp_all(path); });
+    std::println("{} posts, {} tags, {} bytes of tag strings\n", all.posts, all.tags, all.bytes);
+
+    print_result("SQLiteCpp select *", all, all);
+    print_result("SQLiteCpp projected", measure([&] { return sqlitecpp_projected(path); }), all);
+    print_result("C API projected", measure([&] { return raw_projected(path); }), all);
+}
@@ -0,0 +1,186 @@
+/*
+ * Compares ways of splitting tag strings into tags:
+ * - std::views::split, as used before
+ * - tag_tokenizer with every implementation this CPU supports
+ *
+ * Reads the tag strings of every category from the posts table of a database, or generates
+ * strings shaped like them: Zipf-distributed tags of 4 to 40 characters, 1 to ~80 per post.
+ *
+ * Usage: tokenizer_bench [database]
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <print>
+#include <random>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "tag_tokenizer.h"
+
+using std::chrono::steady_clock;
+
+template <> struct std::formatter<std::chrono::nanoseconds> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    auto format(const std::chrono::nanoseconds& ns, format_context& ctx) const {
+        if (ns < std::chrono::microseconds(1)) {
+            return std::format_to(ctx.out(), "{} ns", ns.count());
+        } else if (ns < std::chrono::milliseconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} us", ns.count() / 1e3);
+        } else if (ns < std::chrono::seconds(1)) {
+            return std::format_to(ctx.out(), "{:.3f} ms", ns.count() / 1e6);
+        }
+
+        return std::format_to(ctx.out(), "{:.3f} s", ns.count() / 1e9);
+    }
+};
+
+/* Tag strings of every category of every post, in the order they're stored */
+static std::vector<std::string> read_tag_strings(const std::string& path) {
+    SQLite::Database db { path, SQLite::OPEN_READONLY };
+    SQLite::Statement query { db, "select tag_string_artist, tag_string_copyright, tag_string_character, tag_string_general, tag_string_meta from posts" };
+
+    std::vector<std::string> res;
+    while (query.executeStep()) {
+        for (int i = 0; i < 5; ++i) {
+            res.emplace_back(query.getColumn(i).getText());
+        }
+    }
+
+    return res;
+}
+
+static std::vector<std::string> generate_tag_strings(size_t posts) {
+    std::mt19937 rng { 1 };
+
+    /* Popular tags are short, the long tail is long */
+    static constexpr size_t unique_tags = 200'000;
+    std::vector<std::string> names(unique_tags);
+    for (size_t i = 0; i < unique_tags; ++i) {
+        size_t length = std::min<size_t>(4 + static_cast<size_t>(std::log2(i + 2) * 1.5) + (rng() % 8), 40);
+
+        names[i].resize(length);
+        for (char& c : names[i]) {
+            c = (rng() % 8 == 0) ? '_' : static_cast<char>('a' + (rng() % 26));
+        }
+    }
+
+    std::vector<double> weights(unique_tags);
+    for (size_t i = 0; i < unique_tags; ++i) {
+        weights[i] = 1. / static_cast<double>(i + 1);
+    }
+
+    std::discrete_distribution<size_t> tag_dist { weights.begin(), weights.end() };
+
+    /* General tags dominate, the other categories mostly have a handful */
+    std::poisson_distribution<size_t> general_dist { 28. };
+    std::geometric_distribution<size_t> other_dist { 0.6 };
+
+    std::vector<std::string> res;
+    res.reserve(posts * 5);
+    for (size_t post = 0; post < posts; ++post) {
+        for (int category = 0; category < 5; ++category) {
+            size_t count = (category == 3) ? general_dist(rng) : other_dist(rng);
+
+            std::string& tag_string = res.emplace_back();
+            for (size_t i = 0; i < count; ++i) {
+                if (i > 0) {
+                    tag_string += ' ';
+                }
+
+                tag_string += names[tag_dist(rng)];
+            }
+        }
+    }
+
+    return res;
+}
+
+struct result {
+    std::chrono::nanoseconds time;
+    size_t tags;
+};
+
+/* Best of a few runs */
+template <typename F>
+static result measure(std::span<const std::string> strings, F&& split) {
+    static constexpr int runs = 5;
+
+    result res { std::chrono::nanoseconds::max(), 0 };
+    for (int i = 0; i < runs; ++i) {
+        size_t tags = 0;
+        size_t checksum = 0;
+
+        auto begin = steady_clock::now();
+
+        for (const std::string& str : strings) {
+            split(str, [&](std::string_view tag) {
+                tags += 1;
+                checksum += tag.size();
+            });
+        }
+
+        auto end = steady_clock::now();
+
+        if (checksum == 0 && tags > 0) {
+            std::println(std::cerr, "Unexpected checksum");
+        }
+
+        res.time = std::min<std::chrono::nanoseconds>(res.time, end - begin);
+        res.tags = tags;
+    }
+
+    return res;
+}
+
+static void print_result(std::string_view name, const result& res, size_t bytes) {
+    double seconds = std::chrono::duration<double>(res.time).count();
+    std::println("  {:<18} {:>12} {:>10.1f} MiB/s {:>10.1f} Mtags/s", name, std::format("{}", res.time),
+        bytes / seconds / 1024. / 1024., res.tags / seconds / 1e6);
+}
+
+int main(int argc, char** argv) {
+    std::print(std::cerr, "Preparing tag strings... ");
+    auto strings = (argc > 1) ? read_tag_strings(argv[1]) : generate_tag_strings(1'000'000);
+    std::println(std::cerr, "done");
+
+    size_t bytes = 0;
+    for (const std::string& str : strings) {
+        bytes += str.size();
+    }
+
+    std::println("{} tag strings, {} bytes, {:.1f} bytes on average\n", strings.size(), bytes, static_cast<double>(bytes) / strings.size());
+
+    print_result("std::views::split", measure(strings, [](std::string_view str, auto&& emit) {
+        for (const auto& tag : str | std::views::split(' ')) {
+            if (!tag.empty()) {
+                emit(std::string_view { tag.begin(), tag.end() });
+            }
+        }
+    }), bytes);
+
+    tokenizer_impl best = best_tokenizer_impl();
+    for (auto [impl, name] : { std::pair { tokenizer_impl::scalar, "scalar" }, { tokenizer_impl::sse2, "sse2" }, { tokenizer_impl::avx2, "avx2" } }) {
+        if (impl > best) {
+            break;
+        }
+
+        tag_tokenizer tokenizer { impl };
+        print_result(name, measure(strings, [&tokenizer](std::string_view str, auto&& emit) {
+            for (std::string_view tag : tokenizer.split(str)) {
+                emit(tag);
+            }
+        }), bytes);
+    }
+}